@@ -1,5 +1,6 @@
 #include "Application.h"
 #include "Graphics.h"
+#include "Scene.h"
 #include "physics/Constants.h"
 #include "physics/Constraint.h"
 #include "physics/RigidBody.h"
@@ -23,110 +24,60 @@ void Application::Setup()
 	m_rbArena.Init(MEGABYTE);
 	m_constraintArena.Init(2U * KILOBYTE);
 
-	// Add bird
-	const auto bird = CreateRigidBody(CircleShape(30.0f), 100, Graphics::Height() - 180, 3.0f);
-	bird->SetTexture("bird-red");
-	m_world->AddBody(bird);
-
-	// Add a floor and walls to contain objects
-	const auto floor = CreateRigidBody(BoxShape(Graphics::Width(), 50), Graphics::Width() / 2, Graphics::Height() - 125);
-	const auto roof = CreateRigidBody(BoxShape(Graphics::Width(), 50), Graphics::Width() / 2, -200);
-	const auto leftFence = CreateRigidBody(BoxShape(50, Graphics::Height() * 2), -25, Graphics::Height() / 2);
-	const auto rightFence = CreateRigidBody(BoxShape(50, Graphics::Height() * 2), Graphics::Width() + 25, Graphics::Height() / 2);
-	m_world->AddBody(floor);
-	m_world->AddBody(leftFence);
-	m_world->AddBody(rightFence);
-	m_world->AddBody(roof);
-
-	// Add a stack of boxes
-	for (int i = 1; i <= 4; i++)
-	{
-		const float mass = 10.0f / static_cast<float>(i);
-		const auto box = CreateRigidBody(BoxShape(30, 30), 400, static_cast<int>(floor->m_position.y) - i * 40, mass);
-		box->SetTexture("wood-box");
-		box->m_friction = 0.9f;
-		box->m_restitution = 0.1f;
-		m_world->AddBody(box);
-	}
+	Scene::BuildSample(*m_world, m_rbArena, m_constraintArena, Graphics::Width(), Graphics::Height());
+}
+
+void Application::RecordInput(const std::string& path)
+{
+	m_recordPath = path;
+}
+
+void Application::SetTickRate(const int tickRate)
+{
+	m_fixedDeltaTime = 1.0f / static_cast<float>(tickRate);
+}
 
-	// Add structure with blocks
-	const auto plank1 = CreateRigidBody(BoxShape(30, 90), Graphics::Width() / 2 - 40, static_cast<int>(floor->m_position.y) - 70, 5.0f);
-	const auto plank2 = CreateRigidBody(BoxShape(30, 90), Graphics::Width() / 2 + 60, static_cast<int>(floor->m_position.y) - 70, 5.0f);
-	const auto plank3 = CreateRigidBody(BoxShape(180, 15), Graphics::Width() / 2 + 10, static_cast<int>(floor->m_position.y) - 130, 2.0f);
-	plank1->SetTexture("wood-plank-solid");
-	plank2->SetTexture("wood-plank-solid");
-	plank3->SetTexture("wood-plank-cracked");
-	m_world->AddBody(plank1);
-	m_world->AddBody(plank2);
-	m_world->AddBody(plank3);
-
-	// Add a triangle polygon
-	const std::vector<Vec2> triangleVertices = {
-		Vec2(20, 20),
-		Vec2(-20, 20),
-		Vec2(0, -20)
-	};
-
-	const auto triangle = CreateRigidBody(PolygonShape(triangleVertices), static_cast<int>(plank3->m_position.x), static_cast<int>(plank3->m_position.y) - 50, 0.5f);
-	triangle->SetTexture("wood-triangle");
-	m_world->AddBody(triangle);
-
-	// Add a pyramid of boxes
-	constexpr int numRows = 5;
-	for (int col = 0; col < numRows; col++)
+void Application::SetSubsteps(const int substeps)
+{
+	if (substeps <= 0)
 	{
-		for (int row = 0; row < col; row++)
-		{
-			const int x = static_cast<int>(plank3->m_position.x) + 200 + col * 33 - row * 17;
-			const int y = static_cast<int>(floor->m_position.y) - 50 - row * 52;
-			const float mass = 5.0f / (static_cast<float>(row) + 1.0f);
-			const auto box = CreateRigidBody(BoxShape(30, 30), x, y, mass);
-			box->m_friction = 0.9f;
-			box->m_restitution = 0.0f;
-			box->SetTexture("wood-box");
-			m_world->AddBody(box);
-		}
+		m_world->SetSolver(SOLVER_ITERATIVE);
+		return;
 	}
 
-	// Add a bridge of connected steps and joints
-	constexpr int numSteps = 10;
-	constexpr int spacing = 20;
-	const auto startStep = CreateRigidBody(BoxShape(60, 15), 150, 150);
-	startStep->SetTexture("rock-bridge-anchor");
-	m_world->AddBody(startStep);
+	m_world->SetSolver(SOLVER_SOFT_STEP);
+	m_world->SetSubsteps(substeps);
+}
+
+void Application::SetSolverOrder(const SolverOrder order)
+{
+	m_world->SetSolverOrder(order);
+}
+
+void Application::SetStepBudget(const float budget)
+{
+	// Goes back to the solver settings the world has now
+	m_governor.reset();
+	if (budget > 0.0f)
+		m_governor = std::make_unique<StepGovernor>(*m_world, budget);
+}
+
+void Application::SetLodDistance(const float distance)
+{
+	m_lodDistance = distance;
+}
 
-	auto last = floor;
-	for (int i = 1; i <= numSteps; i++)
+void Application::SetThreads(const int threadCount)
+{
+	// One thread steps the world on the main thread, without a job system
+	m_world->SetJobSystem(nullptr);
+	m_jobSystem.reset();
+
+	if (threadCount != 1)
 	{
-		const int x = static_cast<int>(startStep->m_position.x) + 20 + i * spacing;
-		const int y = static_cast<int>(startStep->m_position.y) + 15;
-		const float mass = i == numSteps ? 0.0f : 3.0f;
-		const auto step = CreateRigidBody(CircleShape(10.0f), x, y, mass);
-		step->SetTexture("wood-bridge-step");
-		m_world->AddBody(step);
-
-		const auto joint = CreateJointConstraint(last, step, step->m_position);
-		m_world->AddConstraint(joint);
-		last = step;
+		m_jobSystem = std::make_unique<JobSystem>(threadCount);
+		m_world->SetJobSystem(m_jobSystem.get());
 	}
-
-	const auto endStep = CreateRigidBody(BoxShape(60, 15), static_cast<int>(last->m_position.x) + 40, static_cast<int>(last->m_position.y) - 15);
-	endStep->SetTexture("rock-bridge-anchor");
-	m_world->AddBody(endStep);
-
-	// Add pigs
-	const auto pig1 = CreateRigidBody(CircleShape(20.0f), static_cast<int>(plank1->m_position.x) + 50, static_cast<int>(floor->m_position.y) - 45, 3.0f);
-	const auto pig2 = CreateRigidBody(CircleShape(20.0f), static_cast<int>(plank2->m_position.x) + 400, static_cast<int>(floor->m_position.y) - 45, 3.0f);
-	const auto pig3 = CreateRigidBody(CircleShape(20.0f), static_cast<int>(pig2->m_position.x) + 40, static_cast<int>(floor->m_position.y) - 45, 3.0f);
-	const auto pig4 = CreateRigidBody(CircleShape(20.0f), 150, 100, 1.0f);
-	pig1->SetTexture("pig-1");
-	pig2->SetTexture("pig-2");
-	pig3->SetTexture("pig-1");
-	pig4->SetTexture("pig-2");
-	m_world->AddBody(pig1);
-	m_world->AddBody(pig2);
-	m_world->AddBody(pig3);
-	m_world->AddBody(pig4);
 }
 
 void Application::ProcessInput()
@@ -135,46 +86,65 @@ void Application::ProcessInput()
 		m_debug = !m_debug;
 
 	if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
-	{
-		const auto circle = CreateRigidBody(CircleShape(20.0f), GetMouseX(), GetMouseY(), 1.0f);
-		circle->m_friction = 0.4f;
-		circle->SetTexture("rock-round");
-		m_world->AddBody(circle);
-	}
+		m_pendingInput.push_back({0, INPUT_SPAWN_CIRCLE, GetMouseX(), GetMouseY()});
 
 	if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
-	{
-		const auto box = CreateRigidBody(BoxShape(40, 40), GetMouseX(), GetMouseY(), 1.0f);
-		box->m_friction = 0.9f;
-		box->m_angularVelocity = 0.0f;
-		box->SetTexture("rock-box");
-		m_world->AddBody(box);
-	}
+		m_pendingInput.push_back({0, INPUT_SPAWN_BOX, GetMouseX(), GetMouseY()});
+
+	m_heldInput.clear();
 
 	if (IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_A))
-	{
-		m_world->GetBodies().at(0)->ApplyImpulseLinear(Vec2(-100.0f, 0.0f));
-	}
+		m_heldInput.push_back({0, INPUT_PUSH_LEFT, 0, 0});
 	else if (IsKeyDown(KEY_RIGHT) || IsKeyDown(KEY_D))
-	{
-		m_world->GetBodies().at(0)->ApplyImpulseLinear(Vec2(100.0f, 0.0f));
-	}
+		m_heldInput.push_back({0, INPUT_PUSH_RIGHT, 0, 0});
 
 	if (IsKeyDown(KEY_UP) || IsKeyDown(KEY_W))
+		m_heldInput.push_back({0, INPUT_PUSH_UP, 0, 0});
+}
+
+void Application::Update()
+{
+	m_accumulator += GetFrameTime();
+
+	// Run as many fixed steps as the elapsed time allows, the remainder carries over to the next frame
+	int steps = 0;
+	while (m_accumulator >= m_fixedDeltaTime && steps < MAX_STEPS_PER_FRAME)
 	{
-		m_world->GetBodies().at(0)->ApplyImpulseLinear(Vec2(0.0f, -200.0f));
+		Step();
+		m_accumulator -= m_fixedDeltaTime;
+		steps++;
 	}
+
+	// We could not keep up, drop the backlog instead of running even more steps next frame
+	if (steps == MAX_STEPS_PER_FRAME && m_accumulator >= m_fixedDeltaTime)
+		m_accumulator = 0.0f;
+
+	m_alpha = m_accumulator / m_fixedDeltaTime;
 }
 
-void Application::Update() const
+void Application::Step()
 {
-	float dt = GetFrameTime();
+	for (const auto& inputs : {&m_pendingInput, &m_heldInput})
+	{
+		for (auto command : *inputs)
+		{
+			command.tick = m_tick;
+			Scene::ApplyInput(*m_world, m_rbArena, command);
 
-	// We tick physics on a fixed delta time
-	if (dt > FIXED_DELTA_TIME)
-		dt = FIXED_DELTA_TIME;
+			if (m_recordPath.empty() == false)
+				m_recordedInput.push_back(command);
+		}
+	}
+
+	m_pendingInput.clear();
 
-	m_world->Update(dt);
+	Scene::FocusOnBird(*m_world, m_lodDistance);
+	if (m_governor != nullptr)
+		m_governor->Step(m_fixedDeltaTime);
+	else
+		m_world->Update(m_fixedDeltaTime);
+
+	m_tick++;
 }
 
 void Application::Render() const
@@ -195,6 +165,30 @@ void Application::Render() const
 		constexpr int posX = 20;
 		DrawText(TextFormat("FPS: %i", static_cast<int>(1 / GetFrameTime())), posX, 10, 10, GREEN);
 		DrawText(TextFormat("FrameTime: %02.02f ms", GetFrameTime() * 1000), posX, 25, 10, GREEN);
+		DrawText(TextFormat("Physics: %i Hz", static_cast<int>(1 / m_fixedDeltaTime + 0.5f)), posX, 70, 10, GREEN);
+
+		const StepStats& stepStats = m_world->GetStepStats();
+		DrawText(TextFormat("Solver: %i iterations, residual %.4f", stepStats.iterations, stepStats.residual), posX, 85, 10, GREEN);
+		DrawText(TextFormat("Narrow phase: %i pairs (%i filtered), SAT cache %i/%i hits", stepStats.narrowPhaseTests, stepStats.filteredPairs, stepStats.satCacheHits, stepStats.satTests), posX, 100, 10, GREEN);
+
+		std::vector<RigidBody*> bodiesUnderMouse;
+		m_world->QueryPoint(Vec2(static_cast<float>(GetMouseX()), static_cast<float>(GetMouseY())), bodiesUnderMouse);
+		DrawText(TextFormat("Under mouse: %i bodies", static_cast<int>(bodiesUnderMouse.size())), posX, 115, 10, GREEN);
+
+		const ContactEvents& contactEvents = m_world->GetContactEvents();
+		DrawText(TextFormat("Contacts: %i begin, %i persist, %i end", static_cast<int>(contactEvents.begin.size()),
+		                    static_cast<int>(contactEvents.persist.size()), static_cast<int>(contactEvents.end.size())), posX, 130, 10, GREEN);
+		DrawText(TextFormat("Step: %.0f us (collisions %.0f us, solver %.0f us)", stepStats.stepTime, stepStats.collisionTime, stepStats.solveTime), posX, 145, 10, GREEN);
+
+		if (m_governor != nullptr)
+		{
+			const GovernorReport& report = m_governor->GetReport();
+			DrawText(TextFormat("Governor: level %i, %i iterations, %i substeps (budget %.0f us)", report.level, report.iterations, report.substeps,
+			                    m_governor->GetBudget()), posX, 160, 10, report.level > 0 ? ORANGE : GREEN);
+		}
+
+		if (m_lodDistance > 0.0f)
+			DrawText(TextFormat("Level of detail: %i bodies skipped (past %.0f px)", stepStats.lodSkippedBodies, m_lodDistance), posX, 175, 10, GREEN);
 
 		const float rbMemUsed = static_cast<float>(m_rbArena.Used()) / MEGABYTE;
 		const float rbMemCapacity = static_cast<float>(m_rbArena.Capacity()) / MEGABYTE;
@@ -206,48 +200,68 @@ void Application::Render() const
 	}
 
 	const auto bodies = m_world->GetBodies();
+	std::vector<Vec2> vertices;
 
 	for (const auto& body : bodies)
 	{
+		// Draw the bodies in between the last two physics steps
+		const Vec2 position = body->InterpolatedPosition(m_alpha);
+		const float rotation = body->InterpolatedRotation(m_alpha);
+
 		if (body->m_shape->GetType() == CIRCLE)
 		{
 			const CircleShape* circleShape = dynamic_cast<CircleShape*>(body->m_shape.get());
 			if (m_debug == false && body->m_textureId.empty() == false)
 			{
-				Graphics::DrawTexture(body->m_position, circleShape->m_radius * 2, circleShape->m_radius * 2,
-				                      body->m_rotation, m_resourceManager->GetTexture(body->m_textureId));
+				Graphics::DrawTexture(position, circleShape->m_radius * 2, circleShape->m_radius * 2,
+				                      rotation, m_resourceManager->GetTexture(body->m_textureId));
 			}
 			else if (m_debug)
 			{
-				Graphics::DrawCircle(body->m_position, circleShape->m_radius, body->m_rotation, GREEN);
+				Graphics::DrawCircle(position, circleShape->m_radius, rotation, GREEN);
 			}
 		}
 
-		if (body->m_shape->GetType() == BOX)
+		if (body->m_shape->GetType() == BOX || body->m_shape->GetType() == POLYGON)
 		{
-			const BoxShape* boxShape = dynamic_cast<BoxShape*>(body->m_shape.get());
+			const PolygonShape* polygonShape = dynamic_cast<PolygonShape*>(body->m_shape.get());
 			if (m_debug == false && body->m_textureId.empty() == false)
 			{
-				Graphics::DrawTexture(body->m_position, static_cast<float>(boxShape->m_width), static_cast<float>(boxShape->m_height),
-				                      body->m_rotation, m_resourceManager->GetTexture(body->m_textureId));
+				Graphics::DrawTexture(position, static_cast<float>(polygonShape->m_width), static_cast<float>(polygonShape->m_height),
+				                      rotation, m_resourceManager->GetTexture(body->m_textureId));
 			}
 			else if (m_debug)
 			{
-				Graphics::DrawPolygon(body->m_position, boxShape->m_worldVertices, GREEN);
+				vertices.clear();
+				for (const auto& vertex : polygonShape->m_localVertices)
+					vertices.push_back(vertex.Rotate(rotation) + position);
+
+				Graphics::DrawPolygon(position, vertices, GREEN);
 			}
 		}
 
-		if (body->m_shape->GetType() == POLYGON)
+		if (body->m_shape->GetType() == CAPSULE || body->m_shape->GetType() == SEGMENT)
 		{
-			const PolygonShape* polygonShape = dynamic_cast<PolygonShape*>(body->m_shape.get());
+			const CapsuleShape* capsuleShape = dynamic_cast<CapsuleShape*>(body->m_shape.get());
 			if (m_debug == false && body->m_textureId.empty() == false)
 			{
-				Graphics::DrawTexture(body->m_position, static_cast<float>(polygonShape->m_width), static_cast<float>(polygonShape->m_height),
-				                      body->m_rotation, m_resourceManager->GetTexture(body->m_textureId));
+				Graphics::DrawTexture(position, capsuleShape->GetWidth(), capsuleShape->GetHeight(),
+				                      rotation, m_resourceManager->GetTexture(body->m_textureId));
 			}
 			else if (m_debug)
 			{
-				Graphics::DrawPolygon(body->m_position, polygonShape->m_worldVertices, GREEN);
+				// Both sides of the segment, closed by the end circles
+				const Vec2 p0 = capsuleShape->m_localVertices[0].Rotate(rotation) + position;
+				const Vec2 p1 = capsuleShape->m_localVertices[1].Rotate(rotation) + position;
+				const Vec2 side = (p1 - p0).Perpendicular() * capsuleShape->m_radius;
+				Graphics::DrawLine(p0 + side, p1 + side, GREEN);
+				Graphics::DrawLine(p0 - side, p1 - side, GREEN);
+
+				if (capsuleShape->m_radius > 0.0f)
+				{
+					Graphics::DrawCircle(p0, capsuleShape->m_radius, rotation, GREEN);
+					Graphics::DrawCircle(p1, capsuleShape->m_radius, rotation, GREEN);
+				}
 			}
 		}
 	}
@@ -257,6 +271,9 @@ void Application::Render() const
 
 void Application::Destroy()
 {
+	if (m_recordPath.empty() == false)
+		SaveInputScript(m_recordPath, m_recordedInput);
+
 	m_rbArena.FreeAll();
 	m_constraintArena.FreeAll();
 
@@ -283,22 +300,3 @@ void Application::LoadResources()
 	m_resourceManager->AddTexture("wood-plank-solid", "wood-plank-solid.png");
 	m_resourceManager->AddTexture("wood-triangle", "wood-triangle.png");
 }
-
-RigidBody* Application::CreateRigidBody(const Shape& shape, const int x, const int y, const float mass)
-{
-	constexpr size_t size = sizeof(RigidBody);
-	const auto rb = static_cast<RigidBody*>(m_rbArena.Allocate(size));
-
-	*rb = RigidBody(shape, x, y, mass);
-
-	return rb;
-}
-
-JointConstraint* Application::CreateJointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& anchorPoint)
-{
-	constexpr size_t size = sizeof(JointConstraint);
-	const auto joint = static_cast<JointConstraint*>(m_constraintArena.Allocate(size));
-	*joint = JointConstraint(aRb, bRb, anchorPoint);
-
-	return joint;
-}
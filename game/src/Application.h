@@ -1,35 +1,60 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
+#include "Input.h"
 #include "ResourcesManager.h"
+#include "jobs/JobSystem.h"
 #include "memory/Arena.h"
-#include "physics/Shape.h"
+#include "physics/Constants.h"
+#include "physics/StepGovernor.h"
 #include "physics/World.h"
 
-struct JointConstraint;
-class RigidBody;
-
 class Application
 {
 private:
+	std::unique_ptr<JobSystem> m_jobSystem; // Outlives the world that uses it
 	std::unique_ptr<World> m_world;
+	std::unique_ptr<StepGovernor> m_governor; // Only with a step budget
 	std::unique_ptr<ResourceManager> m_resourceManager;
 	bool m_debug = false;
+	float m_lodDistance = 0.0f; // See Scene::FocusOnBird
 
 	Arena m_rbArena;
 	Arena m_constraintArena;
 
+	// Fixed timestep: the frame time is accumulated and consumed in steps of m_fixedDeltaTime
+	float m_fixedDeltaTime = FIXED_DELTA_TIME;
+	float m_accumulator = 0.0f;
+	float m_alpha = 1.0f; // How far the rendered frame is between the previous and the current step
+
+	// Input is applied on the fixed steps: clicks are queued, held keys apply on every step
+	uint32_t m_tick = 0;
+	std::vector<InputCommand> m_pendingInput;
+	std::vector<InputCommand> m_heldInput;
+
+	// Input recording, replayable by the headless server
+	std::string m_recordPath;
+	std::vector<InputCommand> m_recordedInput;
+
 public:
 	Application() = default;
 	[[nodiscard]] static bool IsRunning();
 	void Setup();
+	void RecordInput(const std::string& path);
+	void SetTickRate(int tickRate);
+	void SetSubsteps(int substeps);
+	void SetThreads(int threadCount);
+	void SetSolverOrder(SolverOrder order);
+	void SetStepBudget(float budget);
+	void SetLodDistance(float distance);
 	void ProcessInput();
-	void Update() const;
+	void Update();
 	void Render() const;
 	void Destroy();
 
 private:
 	void LoadResources();
-	RigidBody* CreateRigidBody(const Shape& shape, const int x, const int y, const float mass = 0.0f);
-	JointConstraint* CreateJointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& anchorPoint);
+	void Step();
 };
@@ -0,0 +1,159 @@
+#include "BatchRunner.h"
+#include "Scene.h"
+#include "memory/Arena.h"
+#include "physics/Constraint.h"
+#include "physics/RigidBody.h"
+#include "physics/World.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Normal impulse of one contact that kills a pig, about 5 times what the floor pushes on a resting pig every tick
+	constexpr float PIG_KILL_IMPULSE = 120.0f;
+}
+
+BatchRunner::BatchRunner(const BatchConfig& config) : m_config(config)
+{
+	m_config.settleTicks = std::max<uint64_t>(1, m_config.settleTicks);
+	m_jobSystem = std::make_unique<JobSystem>(config.threads);
+}
+
+void BatchRunner::Run(const std::vector<BatchCase>& cases, std::vector<BatchResult>& outResults)
+{
+	outResults.clear();
+	outResults.resize(cases.size());
+
+	// Worlds are independent, each range of cases reuses its own arenas from one world to the next. The worlds have no
+	// job system: they are already spread across the threads.
+	const Clock::time_point start = Clock::now();
+	m_jobSystem->ParallelFor(cases.size(), m_jobSystem->GrainSize(cases.size(), 1), [this, &cases, &outResults](const std::size_t first, const std::size_t last)
+	{
+		Arena rbArena;
+		Arena constraintArena;
+		rbArena.Init(MEGABYTE);
+		constraintArena.Init(2U * KILOBYTE);
+
+		for (std::size_t i = first; i < last; i++)
+			RunCase(cases[i], rbArena, constraintArena, outResults[i]);
+	});
+
+	m_stats.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+	m_stats.worlds += cases.size();
+	for (const auto& result : outResults)
+		m_stats.steps += result.ticks;
+}
+
+const BatchStats& BatchRunner::GetStats() const
+{
+	return m_stats;
+}
+
+void BatchRunner::RunCase(const BatchCase& batchCase, Arena& rbArena, Arena& constraintArena, BatchResult& outResult) const
+{
+	World world(-9.8f);
+	if (batchCase.build)
+		batchCase.build(world, rbArena, constraintArena);
+	else
+		Scene::BuildSample(world, rbArena, constraintArena, m_config.width, m_config.height);
+
+	if (m_config.substeps > 0)
+	{
+		world.SetSolver(SOLVER_SOFT_STEP);
+		world.SetSubsteps(m_config.substeps);
+	}
+
+	world.SetSolverOrder(m_config.solverOrder);
+
+	std::vector<const RigidBody*> pigs;
+	for (const auto body : world.GetBodies())
+	{
+		if (Scene::IsPig(*body))
+			pigs.push_back(body);
+	}
+
+	std::vector<bool> isKilled(pigs.size(), false);
+	const auto hitPig = [&pigs, &isKilled](const RigidBody* body)
+	{
+		const auto it = std::find(pigs.begin(), pigs.end(), body);
+		if (it != pigs.end())
+			isKilled[it - pigs.begin()] = true;
+	};
+
+	if (world.GetBodies().empty() == false)
+		world.GetBodies().front()->m_velocity = batchCase.launchVelocity;
+
+	const float dt = 1.0f / static_cast<float>(m_config.tickRate);
+	std::size_t nextInput = 0;
+	std::vector<Vec2> settlePositions;
+	outResult.ticks = 0;
+	outResult.isSettled = false;
+	for (uint64_t tick = 0; tick < m_config.maxTicks; tick++)
+	{
+		while (nextInput < batchCase.input.size() && batchCase.input[nextInput].tick <= tick)
+			Scene::ApplyInput(world, rbArena, batchCase.input[nextInput++]);
+
+		Scene::FocusOnBird(world, m_config.lodDistance);
+		world.Update(dt);
+		outResult.ticks = tick + 1;
+
+		for (const auto* events : {&world.GetContactEvents().begin, &world.GetContactEvents().persist})
+		{
+			for (const auto& event : *events)
+			{
+				if (event.maxNormalImpulse < PIG_KILL_IMPULSE)
+					continue;
+
+				hitPig(event.a);
+				hitPig(event.b);
+			}
+		}
+
+		// Compare the bodies with where they were at the start of the window, bodies added since then never settle it
+		if (outResult.ticks % m_config.settleTicks != 0)
+			continue;
+
+		const std::vector<RigidBody*>& bodies = world.GetDynamicBodies();
+		bool isSettled = settlePositions.size() == bodies.size();
+		for (std::size_t i = 0; i < bodies.size() && isSettled; i++)
+			isSettled = (bodies[i]->m_position - settlePositions[i]).MagnitudeSquared() <= m_config.settleDistance * m_config.settleDistance;
+
+		if (isSettled)
+		{
+			outResult.isSettled = true;
+			break;
+		}
+
+		settlePositions.clear();
+		for (const auto body : bodies)
+			settlePositions.push_back(body->m_position);
+	}
+
+	// Pigs pushed out of the level count as killed too
+	outResult.pigs = static_cast<int>(pigs.size());
+	outResult.pigsRemaining = 0;
+	for (std::size_t i = 0; i < pigs.size(); i++)
+	{
+		const Vec2& position = pigs[i]->m_position;
+		const bool isInLevel = position.x >= 0.0f && position.x <= static_cast<float>(m_config.width) && position.y <= static_cast<float>(m_config.height);
+		if (isKilled[i] == false && isInLevel)
+			outResult.pigsRemaining++;
+	}
+
+	outResult.positions.clear();
+	for (const auto body : world.GetDynamicBodies())
+		outResult.positions.push_back(body->m_position);
+
+	// The arenas do not run destructors, the shapes of the bodies are freed here before their memory is reused
+	for (const auto body : world.GetBodies())
+		body->~RigidBody();
+
+	for (const auto constraint : world.GetConstraints())
+		constraint->~JointConstraint();
+
+	rbArena.FreeAll();
+	constraintArena.FreeAll();
+}
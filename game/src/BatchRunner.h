@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Input.h"
+#include "jobs/JobSystem.h"
+#include "physics/Constants.h"
+#include "physics/Vec2.h"
+#include "physics/World.h"
+
+class Arena;
+
+struct BatchConfig
+{
+	int tickRate = TICK_RATE;
+	int substeps = 0; // Soft step substeps per tick, 0 keeps the iterative solver
+	SolverOrder solverOrder = ORDER_SEQUENTIAL;
+	uint64_t maxTicks = 600; // Ticks a world runs at most
+	// A world stops once none of its dynamic bodies moved more than the settle distance over this many ticks. Jittering
+	// bodies, like the steps of a bridge, never get to rest but stay in place.
+	uint64_t settleTicks = 30;
+	float settleDistance = 2.0f; // Pixels
+	int threads = 0; // Threads stepping the worlds, 0 for one per hardware thread
+	float lodDistance = 0.0f; // Pixels from the bird past which the islands step less often (see Scene::FocusOnBird), 0 steps them all
+	int width = 1280; // Level size, same as the game window
+	int height = 720;
+};
+
+// One world of a batch: a level with the bird (the first body) launched on the first tick
+struct BatchCase
+{
+	std::function<void(World& world, Arena& rbArena, Arena& constraintArena)> build; // The sample level when empty
+	Vec2 launchVelocity; // Pixels per second
+	std::vector<InputCommand> input; // Replayed on their ticks, like the server does
+};
+
+struct BatchResult
+{
+	int pigs = 0;
+	int pigsRemaining = 0; // Pigs no contact hit hard enough and still in the level
+	uint64_t ticks = 0; // Ticks run before the world settled, or the maximum
+	bool isSettled = false;
+	std::vector<Vec2> positions; // Of the dynamic bodies at the end, in the order they were added
+};
+
+struct BatchStats
+{
+	uint64_t worlds = 0;
+	uint64_t steps = 0; // World steps, over all the worlds
+	double seconds = 0.0;
+
+	[[nodiscard]] double StepsPerSecond() const
+	{
+		return seconds > 0.0 ? static_cast<double>(steps) / seconds : 0.0;
+	}
+};
+
+// Steps many independent worlds without a window, for offline evaluation of levels and launches. Each job builds its
+// worlds in its own arenas and steps them on its thread, the worlds share no mutable state.
+class BatchRunner
+{
+private:
+	BatchConfig m_config;
+	std::unique_ptr<JobSystem> m_jobSystem;
+	BatchStats m_stats;
+
+public:
+	explicit BatchRunner(const BatchConfig& config);
+
+	// Runs every case to the end, the results are in the order of the cases
+	void Run(const std::vector<BatchCase>& cases, std::vector<BatchResult>& outResults);
+	[[nodiscard]] const BatchStats& GetStats() const;
+
+private:
+	void RunCase(const BatchCase& batchCase, Arena& rbArena, Arena& constraintArena, BatchResult& outResult) const;
+};
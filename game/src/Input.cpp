@@ -0,0 +1,65 @@
+#include "Input.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	constexpr const char* INPUT_NAMES[] = {"spawn-circle", "spawn-box", "push-left", "push-right", "push-up"};
+	constexpr int INPUT_COUNT = sizeof(INPUT_NAMES) / sizeof(INPUT_NAMES[0]);
+}
+
+bool LoadInputScript(const std::string& path, std::vector<InputCommand>& outCommands)
+{
+	std::ifstream file(path);
+	if (file.is_open() == false)
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream stream(line);
+		InputCommand command{};
+		std::string name;
+		if (!(stream >> command.tick >> name))
+			return false;
+
+		int type = 0;
+		while (type < INPUT_COUNT && name != INPUT_NAMES[type])
+			type++;
+
+		if (type == INPUT_COUNT)
+			return false;
+
+		command.type = static_cast<InputType>(type);
+		if (command.type == INPUT_SPAWN_CIRCLE || command.type == INPUT_SPAWN_BOX)
+		{
+			if (!(stream >> command.x >> command.y))
+				return false;
+		}
+
+		outCommands.push_back(command);
+	}
+
+	return true;
+}
+
+bool SaveInputScript(const std::string& path, const std::vector<InputCommand>& commands)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (file.is_open() == false)
+		return false;
+
+	for (const auto& command : commands)
+	{
+		file << command.tick << ' ' << INPUT_NAMES[command.type];
+		if (command.type == INPUT_SPAWN_CIRCLE || command.type == INPUT_SPAWN_BOX)
+			file << ' ' << command.x << ' ' << command.y;
+		file << '\n';
+	}
+
+	return file.good();
+}
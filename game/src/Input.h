@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum InputType : uint8_t
+{
+	INPUT_SPAWN_CIRCLE,
+	INPUT_SPAWN_BOX,
+	INPUT_PUSH_LEFT,
+	INPUT_PUSH_RIGHT,
+	INPUT_PUSH_UP
+};
+
+struct InputCommand
+{
+	uint32_t tick;
+	InputType type;
+	int x; // Spawn position
+	int y;
+};
+
+// Input scripts are text files with one "<tick> <command> [x y]" line per command, sorted by tick.
+// Commands are spawn-circle, spawn-box, push-left, push-right and push-up. Lines starting with # are ignored.
+bool LoadInputScript(const std::string& path, std::vector<InputCommand>& outCommands);
+bool SaveInputScript(const std::string& path, const std::vector<InputCommand>& commands);
@@ -1,11 +1,138 @@
 #include "Application.h"
+#include "BatchRunner.h"
+#include "Server.h"
 
-int main(int argc, char *[])
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Usage:
+//   game [--tick-rate <hz>] [--substeps <count>] [--threads <count>] [--colored] [--budget <us>] [--lod <px>] [--record <input file>]
+//   game --server [--tick-rate <hz>] [--substeps <count>] [--threads <count>] [--colored] [--budget <us>] [--lod <px>] [--ticks <count>] [--input <input file>]
+//       [--snapshot <snapshot file>] [--save-snapshot <snapshot file>] [--replication <loss>] [--rollback <ticks>]
+//   game --batch <worlds> [--tick-rate <hz>] [--substeps <count>] [--threads <count>] [--colored] [--lod <px>] [--ticks <count>]
+// --threads 0 uses every hardware thread, the default of 1 steps the world on the main thread (every thread for --batch)
+// --colored solves the constraints in colors across the threads, see World::SetSolverOrder
+// --budget <us> degrades the solver of the game and the server when a step takes longer, see StepGovernor
+// --lod <px> steps the islands farther than this from the bird less often, see Scene::FocusOnBird
+// --replication <loss> sends the server world to a mirror through a loopback channel dropping this fraction of the packets,
+//   then prints the bytes per tick and checks the mirror against the world
+// --save-snapshot <file> saves the server world after the last tick, --snapshot <file> starts from it with its solver settings
+// --rollback <ticks> goes back this many ticks every as many ticks, simulates them again and checks the state hash
+int main(const int argc, char* argv[])
 {
+    bool isServer = false;
+    int batchWorlds = 0;
+    std::string recordPath;
+    ServerConfig serverConfig;
+    BatchConfig batchConfig;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--server") == 0)
+            isServer = true;
+        else if (strcmp(argv[i], "--batch") == 0 && hasValue)
+            batchWorlds = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--record") == 0 && hasValue)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "--tick-rate") == 0 && hasValue)
+            serverConfig.tickRate = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--substeps") == 0 && hasValue)
+            serverConfig.substeps = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+            serverConfig.threads = batchConfig.threads = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--colored") == 0)
+            serverConfig.solverOrder = ORDER_COLORED;
+        else if (strcmp(argv[i], "--budget") == 0 && hasValue)
+            serverConfig.stepBudget = std::max(0.0f, static_cast<float>(atof(argv[++i])));
+        else if (strcmp(argv[i], "--lod") == 0 && hasValue)
+            serverConfig.lodDistance = std::max(0.0f, static_cast<float>(atof(argv[++i])));
+        else if (strcmp(argv[i], "--ticks") == 0 && hasValue)
+            serverConfig.ticks = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--input") == 0 && hasValue)
+            serverConfig.inputPath = argv[++i];
+        else if (strcmp(argv[i], "--snapshot") == 0 && hasValue)
+            serverConfig.snapshotPath = argv[++i];
+        else if (strcmp(argv[i], "--save-snapshot") == 0 && hasValue)
+            serverConfig.saveSnapshotPath = argv[++i];
+        else if (strcmp(argv[i], "--rollback") == 0 && hasValue)
+            serverConfig.rollbackTicks = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+        else if (strcmp(argv[i], "--replication") == 0 && hasValue)
+        {
+            serverConfig.replication = true;
+            serverConfig.packetLoss = std::clamp(static_cast<float>(atof(argv[++i])), 0.0f, 1.0f);
+        }
+    }
+
+    if (batchWorlds > 0)
+    {
+        batchConfig.tickRate = serverConfig.tickRate;
+        batchConfig.substeps = serverConfig.substeps;
+        batchConfig.solverOrder = serverConfig.solverOrder;
+        batchConfig.lodDistance = serverConfig.lodDistance;
+        if (serverConfig.ticks > 0)
+            batchConfig.maxTicks = serverConfig.ticks;
+
+        // Sweep the launch of the bird over angles and speeds, one world per launch
+        std::vector<BatchCase> cases(batchWorlds);
+        const int speeds = std::max(1, static_cast<int>(std::sqrt(static_cast<float>(batchWorlds))));
+        for (int i = 0; i < batchWorlds; i++)
+        {
+            const float angle = 0.2f + 1.2f * static_cast<float>(i / speeds) / static_cast<float>((batchWorlds + speeds - 1) / speeds);
+            const float speed = 500.0f + 1000.0f * static_cast<float>(i % speeds) / static_cast<float>(speeds);
+            cases[i].launchVelocity = Vec2(std::cos(angle), -std::sin(angle)) * speed;
+        }
+
+        BatchRunner runner(batchConfig);
+        std::vector<BatchResult> results;
+        runner.Run(cases, results);
+
+        std::size_t best = 0;
+        for (std::size_t i = 1; i < results.size(); i++)
+        {
+            if (results[i].pigsRemaining < results[best].pigsRemaining)
+                best = i;
+        }
+
+        const BatchStats& stats = runner.GetStats();
+        printf("worlds %llu | steps %llu | %.2f s | %.0f world steps/s\n", static_cast<unsigned long long>(stats.worlds),
+               static_cast<unsigned long long>(stats.steps), stats.seconds, stats.StepsPerSecond());
+        printf("best launch (%.0f, %.0f) px/s: %i of %i pigs remaining after %llu ticks\n", cases[best].launchVelocity.x, cases[best].launchVelocity.y,
+               results[best].pigsRemaining, results[best].pigs, static_cast<unsigned long long>(results[best].ticks));
+
+        return 0;
+    }
+
+    if (isServer)
+    {
+        Server server(serverConfig);
+        if (server.Setup() == false)
+            return 1;
+
+        const bool isMatching = server.Run();
+        server.Destroy();
+
+        return isMatching ? 0 : 1;
+    }
+
     Application app;
 
     app.Setup();
 
+    app.SetTickRate(serverConfig.tickRate);
+    app.SetSubsteps(serverConfig.substeps);
+    app.SetThreads(serverConfig.threads);
+    app.SetSolverOrder(serverConfig.solverOrder);
+    app.SetStepBudget(serverConfig.stepBudget);
+    app.SetLodDistance(serverConfig.lodDistance);
+
+    if (recordPath.empty() == false)
+        app.RecordInput(recordPath);
+
     while (Application::IsRunning()) 
     {
         app.ProcessInput();
@@ -16,4 +143,4 @@ int main(int argc, char *[])
     app.Destroy();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,190 @@
+#include "Scene.h"
+#include "memory/Arena.h"
+#include "physics/Constraint.h"
+#include "physics/RigidBody.h"
+#include "physics/Shape.h"
+#include "physics/World.h"
+
+#include <new>
+
+void Scene::BuildSample(World& world, Arena& rbArena, Arena& constraintArena, const int width, const int height)
+{
+	// Add bird
+	const auto bird = CreateRigidBody(rbArena, CircleShape(30.0f), 100, height - 180, 3.0f);
+	bird->SetTexture("bird-red");
+	bird->m_isBullet = true; // Launched fast enough to go through the planks
+	world.AddBody(bird);
+
+	// Add a floor and walls to contain objects
+	const auto floor = CreateRigidBody(rbArena, BoxShape(width, 50), width / 2, height - 125);
+	const auto roof = CreateRigidBody(rbArena, BoxShape(width, 50), width / 2, -200);
+	const auto leftFence = CreateRigidBody(rbArena, BoxShape(50, height * 2), -25, height / 2);
+	const auto rightFence = CreateRigidBody(rbArena, BoxShape(50, height * 2), width + 25, height / 2);
+	world.AddBody(floor);
+	world.AddBody(leftFence);
+	world.AddBody(rightFence);
+	world.AddBody(roof);
+
+	// Add a stack of boxes
+	for (int i = 1; i <= 4; i++)
+	{
+		const float mass = 10.0f / static_cast<float>(i);
+		const auto box = CreateRigidBody(rbArena, BoxShape(30, 30), 400, static_cast<int>(floor->m_position.y) - i * 40, mass);
+		box->SetTexture("wood-box");
+		box->m_friction = 0.9f;
+		box->m_restitution = 0.1f;
+		world.AddBody(box);
+	}
+
+	// Add structure with blocks
+	const auto plank1 = CreateRigidBody(rbArena, BoxShape(30, 90), width / 2 - 40, static_cast<int>(floor->m_position.y) - 70, 5.0f);
+	const auto plank2 = CreateRigidBody(rbArena, BoxShape(30, 90), width / 2 + 60, static_cast<int>(floor->m_position.y) - 70, 5.0f);
+	const auto plank3 = CreateRigidBody(rbArena, CapsuleShape(82.5f, 7.5f), width / 2 + 10, static_cast<int>(floor->m_position.y) - 130, 2.0f);
+	plank1->SetTexture("wood-plank-solid");
+	plank2->SetTexture("wood-plank-solid");
+	plank3->SetTexture("wood-plank-cracked");
+	world.AddBody(plank1);
+	world.AddBody(plank2);
+	world.AddBody(plank3);
+
+	// Add a triangle polygon
+	const std::vector<Vec2> triangleVertices = {
+		Vec2(20, 20),
+		Vec2(-20, 20),
+		Vec2(0, -20)
+	};
+
+	const auto triangle = CreateRigidBody(rbArena, PolygonShape(triangleVertices), static_cast<int>(plank3->m_position.x), static_cast<int>(plank3->m_position.y) - 50, 0.5f);
+	triangle->SetTexture("wood-triangle");
+	world.AddBody(triangle);
+
+	// Add a pyramid of boxes
+	constexpr int numRows = 5;
+	for (int col = 0; col < numRows; col++)
+	{
+		for (int row = 0; row < col; row++)
+		{
+			const int x = static_cast<int>(plank3->m_position.x) + 200 + col * 33 - row * 17;
+			const int y = static_cast<int>(floor->m_position.y) - 50 - row * 52;
+			const float mass = 5.0f / (static_cast<float>(row) + 1.0f);
+			const auto box = CreateRigidBody(rbArena, BoxShape(30, 30), x, y, mass);
+			box->m_friction = 0.9f;
+			box->m_restitution = 0.0f;
+			box->SetTexture("wood-box");
+			world.AddBody(box);
+		}
+	}
+
+	// Add a bridge of connected steps and joints
+	constexpr int numSteps = 10;
+	constexpr int spacing = 20;
+	const auto startStep = CreateRigidBody(rbArena, BoxShape(60, 15), 150, 150);
+	startStep->SetTexture("rock-bridge-anchor");
+	world.AddBody(startStep);
+
+	auto last = floor;
+	for (int i = 1; i <= numSteps; i++)
+	{
+		const int x = static_cast<int>(startStep->m_position.x) + 20 + i * spacing;
+		const int y = static_cast<int>(startStep->m_position.y) + 15;
+		const float mass = i == numSteps ? 0.0f : 3.0f;
+		const auto step = CreateRigidBody(rbArena, CapsuleShape(5.0f, 5.0f), x, y, mass);
+		step->SetTexture("wood-bridge-step");
+		world.AddBody(step);
+
+		const auto joint = CreateJointConstraint(constraintArena, last, step, step->m_position);
+		world.AddConstraint(joint);
+		last = step;
+	}
+
+	const auto endStep = CreateRigidBody(rbArena, BoxShape(60, 15), static_cast<int>(last->m_position.x) + 40, static_cast<int>(last->m_position.y) - 15);
+	endStep->SetTexture("rock-bridge-anchor");
+	world.AddBody(endStep);
+
+	// Add pigs
+	const auto pig1 = CreateRigidBody(rbArena, CircleShape(20.0f), static_cast<int>(plank1->m_position.x) + 50, static_cast<int>(floor->m_position.y) - 45, 3.0f);
+	const auto pig2 = CreateRigidBody(rbArena, CircleShape(20.0f), static_cast<int>(plank2->m_position.x) + 400, static_cast<int>(floor->m_position.y) - 45, 3.0f);
+	const auto pig3 = CreateRigidBody(rbArena, CircleShape(20.0f), static_cast<int>(pig2->m_position.x) + 40, static_cast<int>(floor->m_position.y) - 45, 3.0f);
+	const auto pig4 = CreateRigidBody(rbArena, CircleShape(20.0f), 150, 100, 1.0f);
+	pig1->SetTexture("pig-1");
+	pig2->SetTexture("pig-2");
+	pig3->SetTexture("pig-1");
+	pig4->SetTexture("pig-2");
+	world.AddBody(pig1);
+	world.AddBody(pig2);
+	world.AddBody(pig3);
+	world.AddBody(pig4);
+}
+
+void Scene::ApplyInput(World& world, Arena& rbArena, const InputCommand& command)
+{
+	switch (command.type)
+	{
+	case INPUT_SPAWN_CIRCLE:
+	{
+		const auto circle = CreateRigidBody(rbArena, CircleShape(20.0f), command.x, command.y, 1.0f);
+		circle->m_friction = 0.4f;
+		circle->SetTexture("rock-round");
+		circle->m_isBullet = true;
+		world.QueueAddBody(circle);
+		break;
+	}
+	case INPUT_SPAWN_BOX:
+	{
+		const auto box = CreateRigidBody(rbArena, BoxShape(40, 40), command.x, command.y, 1.0f);
+		box->m_friction = 0.9f;
+		box->m_angularVelocity = 0.0f;
+		box->SetTexture("rock-box");
+		world.QueueAddBody(box);
+		break;
+	}
+	case INPUT_PUSH_LEFT:
+	case INPUT_PUSH_RIGHT:
+	case INPUT_PUSH_UP:
+	{
+		// The pushes move the bird, the first body of the sample scene. A world built without bodies ignores them.
+		if (world.GetBodies().empty())
+			break;
+
+		const Vec2 impulse = command.type == INPUT_PUSH_LEFT ? Vec2(-100.0f, 0.0f) : command.type == INPUT_PUSH_RIGHT ? Vec2(100.0f, 0.0f) : Vec2(0.0f, -200.0f);
+		world.GetBodies().front()->ApplyImpulseLinear(impulse);
+		break;
+	}
+	}
+}
+
+bool Scene::IsPig(const RigidBody& body)
+{
+	return body.m_textureId.compare(0, 3, "pig") == 0;
+}
+
+void Scene::FocusOnBird(World& world, const float lodDistance)
+{
+	if (lodDistance <= 0.0f || world.GetBodies().empty())
+	{
+		if (world.GetFocusPoints().empty() == false)
+			world.SetFocusPoints({});
+
+		return;
+	}
+
+	world.SetLodDistances(lodDistance, lodDistance * 2.0f);
+	world.SetFocusPoints({world.GetBodies().front()->m_position});
+}
+
+RigidBody* Scene::CreateRigidBody(Arena& rbArena, const Shape& shape, const int x, const int y, const float mass)
+{
+	constexpr size_t size = sizeof(RigidBody);
+	void* memory = rbArena.Allocate(size, alignof(RigidBody));
+
+	// Construct in place, the arena memory does not hold a RigidBody yet
+	return new(memory) RigidBody(shape, x, y, mass);
+}
+
+JointConstraint* Scene::CreateJointConstraint(Arena& constraintArena, RigidBody* aRb, RigidBody* bRb, const Vec2& anchorPoint)
+{
+	constexpr size_t size = sizeof(JointConstraint);
+	void* memory = constraintArena.Allocate(size, alignof(JointConstraint));
+
+	return new(memory) JointConstraint(aRb, bRb, anchorPoint);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Input.h"
+
+class Arena;
+class RigidBody;
+class Shape;
+class World;
+struct JointConstraint;
+struct Vec2;
+
+// Builds the levels and applies the player input, shared by the windowed game and the headless server.
+// Bodies and joints are placed in the given arenas. The bodies spawned by the input are queued, the world adds them at
+// the start of its next step.
+class Scene
+{
+public:
+	static void BuildSample(World& world, Arena& rbArena, Arena& constraintArena, int width, int height);
+	static void ApplyInput(World& world, Arena& rbArena, const InputCommand& command);
+
+	// Pigs are the targets of a level, told apart by their texture
+	static bool IsPig(const RigidBody& body);
+
+	// Steps the islands far from the bird (the first body) less often, see World::SetFocusPoints. Islands farther than
+	// the distance step at half rate, twice as far at a quarter. A distance of 0 steps every island on every tick.
+	static void FocusOnBird(World& world, float lodDistance);
+
+	static RigidBody* CreateRigidBody(Arena& rbArena, const Shape& shape, int x, int y, float mass = 0.0f);
+	static JointConstraint* CreateJointConstraint(Arena& constraintArena, RigidBody* aRb, RigidBody* bRb, const Vec2& anchorPoint);
+};
@@ -0,0 +1,339 @@
+#include "Server.h"
+#include "Scene.h"
+#include "physics/Constants.h"
+#include "physics/RigidBody.h"
+#include "physics/Snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// The OS sleep is only trusted up to this margin before the deadline, the rest is spent yielding
+	constexpr std::chrono::microseconds SPIN_MARGIN(1500);
+
+	// Past this many late ticks the scheduler stops catching up and moves the deadlines forward
+	constexpr int MAX_CATCH_UP_TICKS = 5;
+
+	// Loopback replication: one way latency, and the ticks sent without stepping before the mirror is checked
+	constexpr int REPLICATION_LATENCY_TICKS = 3;
+	constexpr int MIRROR_SETTLE_TICKS = 60;
+
+	std::atomic<bool> s_interrupted(false);
+
+	void OnInterrupt(int)
+	{
+		s_interrupted = true;
+	}
+
+	void SleepUntil(const Clock::time_point deadline)
+	{
+		if (deadline - Clock::now() > SPIN_MARGIN)
+			std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+
+		while (Clock::now() < deadline)
+			std::this_thread::yield();
+	}
+}
+
+Server::Server(const ServerConfig& config) : m_config(config) {}
+
+bool Server::Setup()
+{
+	m_rbArena.Init(MEGABYTE);
+	m_constraintArena.Init(2U * KILOBYTE);
+
+	m_world = BuildWorld(m_rbArena, m_constraintArena);
+	if (m_world == nullptr)
+		return false;
+
+	// The mirror starts from the same world, the replicated states then move its bodies
+	if (m_config.replication)
+	{
+		m_mirrorRbArena.Init(MEGABYTE);
+		m_mirrorConstraintArena.Init(2U * KILOBYTE);
+		m_mirror = BuildWorld(m_mirrorRbArena, m_mirrorConstraintArena);
+		if (m_mirror == nullptr)
+			return false;
+
+		m_replicationServer = std::make_unique<ReplicationServer>();
+		m_replicationClient = std::make_unique<ReplicationClient>();
+		m_downlink = std::make_unique<LoopbackChannel>(m_config.packetLoss, REPLICATION_LATENCY_TICKS, 1);
+		m_uplink = std::make_unique<LoopbackChannel>(m_config.packetLoss, REPLICATION_LATENCY_TICKS, 2);
+	}
+
+	if (m_config.substeps > 0)
+	{
+		m_world->SetSolver(SOLVER_SOFT_STEP);
+		m_world->SetSubsteps(m_config.substeps);
+	}
+
+	// A snapshot keeps the solver order it was saved with, unless the command line asks for the colored one
+	if (m_config.snapshotPath.empty() || m_config.solverOrder != ORDER_SEQUENTIAL)
+		m_world->SetSolverOrder(m_config.solverOrder);
+
+	// One thread steps the world on this thread, without a job system
+	if (m_config.threads != 1)
+	{
+		m_jobSystem = std::make_unique<JobSystem>(m_config.threads);
+		m_world->SetJobSystem(m_jobSystem.get());
+	}
+
+	// Made once the solver is set, its settings are the ones the governor goes back to
+	if (m_config.stepBudget > 0.0f)
+		m_governor = std::make_unique<StepGovernor>(*m_world, m_config.stepBudget);
+
+	// The governor picks the solver settings from the time a step takes, a tick simulated again would not get the same
+	if (m_config.rollbackTicks > 0)
+	{
+		if (m_governor != nullptr)
+		{
+			printf("The rollback check does not run with a step budget\n");
+			return false;
+		}
+
+		m_rollback = std::make_unique<RollbackBuffer>(m_config.rollbackTicks);
+	}
+
+	if (m_config.inputPath.empty() == false && LoadInputScript(m_config.inputPath, m_input) == false)
+	{
+		printf("Could not load input script %s\n", m_config.inputPath.c_str());
+		return false;
+	}
+
+	std::signal(SIGINT, OnInterrupt);
+	return true;
+}
+
+bool Server::Run()
+{
+	const auto tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_config.tickRate));
+	const uint64_t reportInterval = static_cast<uint64_t>(m_config.tickRate) * 10;
+
+	Clock::time_point deadline = Clock::now() + tickDuration;
+	for (uint64_t tick = 0; m_config.ticks == 0 || tick < m_config.ticks; tick++)
+	{
+		if (s_interrupted)
+			break;
+
+		const Clock::time_point start = Clock::now();
+		Tick(tick);
+		const Clock::time_point end = Clock::now();
+
+		const double stepMs = std::chrono::duration<double, std::milli>(end - start).count();
+		m_stats.ticks++;
+		m_stats.totalStepMs += stepMs;
+		m_stats.maxStepMs = std::max(m_stats.maxStepMs, stepMs);
+		m_stats.totalIterations += static_cast<uint64_t>(m_world->GetStepStats().iterations);
+		m_stats.maxResidual = std::max(m_stats.maxResidual, m_world->GetStepStats().residual);
+
+		if (end > deadline)
+		{
+			m_stats.overruns++;
+			m_stats.maxLatenessMs = std::max(m_stats.maxLatenessMs, std::chrono::duration<double, std::milli>(end - deadline).count());
+
+			// Run the late ticks back to back, unless we are so far behind that we would never catch up
+			if (end - deadline > tickDuration * MAX_CATCH_UP_TICKS)
+			{
+				const auto behind = (end - deadline) / tickDuration;
+				m_stats.skippedTicks += static_cast<uint64_t>(behind);
+				deadline += tickDuration * behind;
+			}
+		}
+		else
+		{
+			SleepUntil(deadline);
+		}
+
+		deadline += tickDuration;
+
+		if ((tick + 1) % reportInterval == 0)
+			PrintStats();
+	}
+
+	if (m_stats.ticks % reportInterval != 0)
+		PrintStats();
+
+	if (m_rollback != nullptr)
+	{
+		printf("rollback %llu checks over %u ticks | mismatches %llu | skipped %llu (input) | frames %zu bytes\n",
+		       static_cast<unsigned long long>(m_stats.rollbackChecks), m_config.rollbackTicks, static_cast<unsigned long long>(m_stats.rollbackMismatches),
+		       static_cast<unsigned long long>(m_stats.rollbackSkipped), m_rollback->MemoryUsed());
+	}
+
+	const bool isMirrorMatching = m_mirror == nullptr || CheckMirror();
+
+	bool isSaved = true;
+	if (m_config.saveSnapshotPath.empty() == false)
+	{
+		isSaved = Snapshot::Save(*m_world, m_config.saveSnapshotPath);
+		printf(isSaved ? "Saved snapshot %s\n" : "Could not save snapshot %s\n", m_config.saveSnapshotPath.c_str());
+	}
+
+	return isMirrorMatching && m_stats.rollbackMismatches == 0 && isSaved;
+}
+
+void Server::Destroy()
+{
+	m_governor.reset();
+	m_mirror.reset();
+	m_mirrorRbArena.FreeAll();
+	m_mirrorConstraintArena.FreeAll();
+	m_world.reset();
+	m_jobSystem.reset();
+	m_rbArena.FreeAll();
+	m_constraintArena.FreeAll();
+}
+
+const TickStats& Server::GetStats() const
+{
+	return m_stats;
+}
+
+void Server::Tick(const uint64_t tick)
+{
+	if (m_rollback != nullptr)
+		m_rollback->Save(*m_world, static_cast<uint32_t>(tick));
+
+	while (m_nextInput < m_input.size() && m_input[m_nextInput].tick <= tick)
+	{
+		Scene::ApplyInput(*m_world, m_rbArena, m_input[m_nextInput++]);
+		m_lastInputTick = tick;
+	}
+
+	Scene::FocusOnBird(*m_world, m_config.lodDistance);
+	if (m_governor != nullptr)
+		m_governor->Step(1.0f / static_cast<float>(m_config.tickRate));
+	else
+		m_world->Update(1.0f / static_cast<float>(m_config.tickRate));
+
+	if (m_mirror != nullptr)
+		Replicate();
+
+	if (m_rollback != nullptr && (tick + 1) % m_config.rollbackTicks == 0)
+		CheckRollback(tick);
+}
+
+void Server::CheckRollback(const uint64_t tick)
+{
+	// Go back to the start of the window and step it again, the world must end up in the same state
+	const uint64_t first = tick + 1 - m_config.rollbackTicks;
+	if (m_lastInputTick != UINT64_MAX && m_lastInputTick >= first)
+	{
+		m_stats.rollbackSkipped++;
+		return;
+	}
+
+	const uint64_t hash = m_world->ComputeStateHash();
+	if (m_rollback->Restore(*m_world, static_cast<uint32_t>(first)) == false)
+	{
+		m_stats.rollbackSkipped++;
+		return;
+	}
+
+	for (uint64_t i = first; i <= tick; i++)
+	{
+		Scene::FocusOnBird(*m_world, m_config.lodDistance);
+		m_world->Update(1.0f / static_cast<float>(m_config.tickRate));
+	}
+
+	m_stats.rollbackChecks++;
+	if (m_world->ComputeStateHash() != hash)
+	{
+		m_stats.rollbackMismatches++;
+		printf("rollback mismatch at tick %llu: %016llx simulated again to %016llx\n", static_cast<unsigned long long>(tick),
+		       static_cast<unsigned long long>(hash), static_cast<unsigned long long>(m_world->ComputeStateHash()));
+	}
+}
+
+std::unique_ptr<World> Server::BuildWorld(Arena& rbArena, Arena& constraintArena) const
+{
+	if (m_config.snapshotPath.empty())
+	{
+		auto world = std::make_unique<World>(-9.8f);
+		Scene::BuildSample(*world, rbArena, constraintArena, m_config.width, m_config.height);
+		return world;
+	}
+
+	auto world = Snapshot::Load(m_config.snapshotPath, rbArena, constraintArena);
+	if (world == nullptr)
+		printf("Could not load snapshot %s\n", m_config.snapshotPath.c_str());
+
+	return world;
+}
+
+void Server::Replicate()
+{
+	m_replicationServer->Encode(*m_world, m_packet);
+	m_downlink->Send(m_packet);
+
+	for (const auto& packet : m_downlink->Tick())
+	{
+		if (m_replicationClient->Decode(packet, *m_mirror) == false)
+		{
+			m_rejectedPackets++;
+			continue;
+		}
+
+		const uint16_t sequence = m_replicationClient->GetLastDecoded();
+		m_uplink->Send({static_cast<uint8_t>(sequence & 0xFF), static_cast<uint8_t>(sequence >> 8)});
+	}
+
+	for (const auto& packet : m_uplink->Tick())
+		m_replicationServer->Acknowledge(static_cast<uint16_t>(packet[0] | packet[1] << 8));
+}
+
+bool Server::CheckMirror()
+{
+	const float bytesPerTick = m_replicationServer->GetAverageBytesPerTick();
+	const float bodiesPerTick = m_replicationServer->GetAverageBodiesPerTick();
+
+	// Keep sending the last state until the mirror caught up, it then stays within the send threshold of the world
+	for (int i = 0; i < MIRROR_SETTLE_TICKS; i++)
+		Replicate();
+
+	const auto& bodies = m_world->GetBodies();
+	const auto& mirrorBodies = m_mirror->GetBodies();
+	const std::size_t count = std::min(bodies.size(), mirrorBodies.size());
+	// The server sends a body once it moved past the threshold on one axis, the error is measured the same way
+	float maxError = 0.0f;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		const Vec2 error = bodies[i]->m_position - mirrorBodies[i]->m_position;
+		maxError = std::max(maxError, std::max(std::abs(error.x), std::abs(error.y)));
+	}
+
+	const ReplicationConfig config;
+	const bool isMatching = maxError <= config.positionThreshold + config.positionPrecision;
+	printf("replication %.1f bytes/tick (%.1f bodies/tick, %zu bytes raw) | lost %llu of %llu | rejected %llu | mirror max error %.3f px: %s\n",
+	       bytesPerTick, bodiesPerTick, bodies.size() * 3 * sizeof(float),
+	       static_cast<unsigned long long>(m_downlink->PacketsLost()), static_cast<unsigned long long>(m_downlink->PacketsSent()),
+	       static_cast<unsigned long long>(m_rejectedPackets), maxError, isMatching ? "ok" : "MISMATCH");
+
+	return isMatching;
+}
+
+void Server::PrintStats() const
+{
+	const double averageMs = m_stats.ticks > 0 ? m_stats.totalStepMs / static_cast<double>(m_stats.ticks) : 0.0;
+	const double averageIterations = m_stats.ticks > 0 ? static_cast<double>(m_stats.totalIterations) / static_cast<double>(m_stats.ticks) : 0.0;
+	printf("ticks %llu | bodies %zu | step avg %.3f ms max %.3f ms | overruns %llu (max late %.3f ms) | skipped %llu | iterations avg %.1f (max residual %.4f) | hash %016llx\n",
+	       static_cast<unsigned long long>(m_stats.ticks), m_world->GetBodies().size(), averageMs, m_stats.maxStepMs,
+	       static_cast<unsigned long long>(m_stats.overruns), m_stats.maxLatenessMs, static_cast<unsigned long long>(m_stats.skippedTicks),
+	       averageIterations, m_stats.maxResidual, static_cast<unsigned long long>(m_world->ComputeStateHash()));
+
+	if (m_governor != nullptr)
+	{
+		const GovernorReport& report = m_governor->GetReport();
+		printf("governor level %i (%i iterations, %i position iterations, %i substeps) | over budget %llu | degraded %llu\n", report.level,
+		       report.iterations, report.positionIterations, report.substeps, static_cast<unsigned long long>(report.overBudgetSteps),
+		       static_cast<unsigned long long>(report.degradedSteps));
+	}
+}
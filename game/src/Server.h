@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Input.h"
+#include "jobs/JobSystem.h"
+#include "memory/Arena.h"
+#include "network/LoopbackChannel.h"
+#include "network/Replication.h"
+#include "physics/Constants.h"
+#include "physics/RollbackBuffer.h"
+#include "physics/StepGovernor.h"
+#include "physics/World.h"
+
+struct ServerConfig
+{
+	int tickRate = TICK_RATE;
+	int substeps = 0; // Soft step substeps per tick, 0 keeps the iterative solver
+	int threads = 1; // Threads stepping the world, 0 for one per hardware thread
+	SolverOrder solverOrder = ORDER_SEQUENTIAL;
+	float stepBudget = 0.0f; // Microseconds, past it the solver is degraded (see StepGovernor), 0 never degrades it
+	float lodDistance = 0.0f; // Pixels from the bird past which the islands step less often (see Scene::FocusOnBird), 0 steps them all
+	uint64_t ticks = 0; // Number of ticks to run, 0 runs until interrupted
+	int width = 1280; // Level size, same as the game window
+	int height = 720;
+	std::string inputPath; // Scripted or recorded input to replay
+	std::string snapshotPath; // Start from a world snapshot instead of building the sample scene, with its solver settings
+	std::string saveSnapshotPath; // Save the world there after the last tick
+	bool replication = false; // Send the world to a mirror world through a loopback channel, see ReplicationServer
+	float packetLoss = 0.0f; // Packets dropped by the loopback channel, in both directions
+	uint32_t rollbackTicks = 0; // Every this many ticks, go back as many ticks, simulate them again and check the state hash
+};
+
+struct TickStats
+{
+	uint64_t ticks = 0;
+	uint64_t overruns = 0; // Ticks that finished after their deadline
+	uint64_t skippedTicks = 0; // Deadlines dropped to catch up after a long stall
+	double totalStepMs = 0.0;
+	double maxStepMs = 0.0;
+	double maxLatenessMs = 0.0;
+	uint64_t totalIterations = 0; // Solver iterations, see World::GetStepStats
+	float maxResidual = 0.0f;
+	uint64_t rollbackChecks = 0;
+	uint64_t rollbackMismatches = 0; // Simulated again to another state hash
+	uint64_t rollbackSkipped = 0; // Windows with input, which is not applied again
+};
+
+// Runs the simulation without a window: no raylib calls, no textures, the world is stepped on a fixed tick
+class Server
+{
+private:
+	ServerConfig m_config;
+	std::unique_ptr<JobSystem> m_jobSystem; // Outlives the world that uses it
+	std::unique_ptr<World> m_world;
+	std::unique_ptr<StepGovernor> m_governor;
+	std::vector<InputCommand> m_input;
+	std::size_t m_nextInput = 0;
+	uint64_t m_lastInputTick = UINT64_MAX;
+	std::unique_ptr<RollbackBuffer> m_rollback;
+	TickStats m_stats;
+
+	Arena m_rbArena;
+	Arena m_constraintArena;
+
+	// Client side of the replication, its world only moves with the received states
+	std::unique_ptr<World> m_mirror;
+	std::unique_ptr<ReplicationServer> m_replicationServer;
+	std::unique_ptr<ReplicationClient> m_replicationClient;
+	std::unique_ptr<LoopbackChannel> m_downlink; // Server to client states
+	std::unique_ptr<LoopbackChannel> m_uplink; // Client to server acknowledgements
+	std::vector<uint8_t> m_packet;
+	uint64_t m_rejectedPackets = 0;
+	Arena m_mirrorRbArena;
+	Arena m_mirrorConstraintArena;
+
+public:
+	explicit Server(const ServerConfig& config);
+	bool Setup();
+	bool Run(); // False if the replicated mirror does not match the world, a rollback changed the state or the snapshot could not be saved
+	void Destroy();
+
+	[[nodiscard]] const TickStats& GetStats() const;
+
+private:
+	void Tick(uint64_t tick);
+	[[nodiscard]] std::unique_ptr<World> BuildWorld(Arena& rbArena, Arena& constraintArena) const;
+	void Replicate();
+	void CheckRollback(uint64_t tick);
+	bool CheckMirror();
+	void PrintStats() const;
+};
@@ -0,0 +1,147 @@
+#include "JobSystem.h"
+
+namespace
+{
+	// Index of the worker running on this thread, for the job system it belongs to
+	thread_local const JobSystem* t_jobSystem = nullptr;
+	thread_local std::size_t t_workerIndex = 0;
+}
+
+JobSystem::JobSystem(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	// Deque 0 belongs to the threads that are not workers
+	for (int i = 0; i < threadCount; i++)
+		m_workers.push_back(std::make_unique<Worker>());
+
+	for (int i = 1; i < threadCount; i++)
+		m_threads.emplace_back(&JobSystem::WorkerLoop, this, static_cast<std::size_t>(i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_isStopping = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+int JobSystem::GetThreadCount() const
+{
+	return static_cast<int>(m_workers.size());
+}
+
+void JobSystem::Run(JobGroup& group, std::function<void()> job)
+{
+	group.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+	if (m_threads.empty())
+	{
+		job();
+		group.m_pending.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+
+	Worker& worker = *m_workers[CurrentWorker()];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back({std::move(job), &group});
+	}
+
+	// Counted under the sleep mutex, a worker about to sleep sees it
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queued.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_wake.notify_one();
+}
+
+void JobSystem::Wait(JobGroup& group)
+{
+	const std::size_t index = CurrentWorker();
+	Job job;
+	while (group.m_pending.load(std::memory_order_acquire) > 0)
+	{
+		// Help instead of blocking, the jobs of the group may be waiting in a deque
+		if (PopOrSteal(index, job))
+		{
+			job.function();
+			job.group->m_pending.fetch_sub(1, std::memory_order_release);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+std::size_t JobSystem::GrainSize(const std::size_t count, const std::size_t minGrain) const
+{
+	const std::size_t ranges = 4 * m_workers.size();
+	return std::max<std::size_t>(std::max<std::size_t>(minGrain, 1), (count + ranges - 1) / ranges);
+}
+
+std::size_t JobSystem::CurrentWorker() const
+{
+	return t_jobSystem == this ? t_workerIndex : 0;
+}
+
+bool JobSystem::PopOrSteal(const std::size_t index, Job& outJob)
+{
+	// Newest job of our own deque first, it is the most likely to be in cache
+	{
+		Worker& worker = *m_workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.jobs.empty() == false)
+		{
+			outJob = std::move(worker.jobs.back());
+			worker.jobs.pop_back();
+			m_queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Then the oldest job of the others
+	for (std::size_t i = 1; i < m_workers.size(); i++)
+	{
+		Worker& victim = *m_workers[(index + i) % m_workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.jobs.empty() == false)
+		{
+			outJob = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			m_queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::WorkerLoop(const std::size_t index)
+{
+	t_jobSystem = this;
+	t_workerIndex = index;
+
+	Job job;
+	for (;;)
+	{
+		if (PopOrSteal(index, job))
+		{
+			job.function();
+			job.group->m_pending.fetch_sub(1, std::memory_order_release);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this] { return m_isStopping || m_queued.load(std::memory_order_relaxed) > 0; });
+		if (m_isStopping && m_queued.load(std::memory_order_relaxed) == 0)
+			return;
+	}
+}
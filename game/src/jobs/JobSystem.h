@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs of one fork/join: Run adds jobs to the group, Wait returns once all of them are done
+class JobGroup
+{
+public:
+	JobGroup() = default;
+	JobGroup(const JobGroup& group) = delete;
+	JobGroup& operator=(const JobGroup& group) = delete;
+
+private:
+	friend class JobSystem;
+	std::atomic<int> m_pending{0};
+};
+
+// Work stealing scheduler.
+// Every thread has its own deque of jobs: it pushes and pops its jobs at the back, and when it runs out it steals from the
+// front of the other deques, where the oldest (so largest) jobs are. The threads that are not workers, like the one
+// calling World::Update, share the first deque. A thread waiting on a group runs jobs instead of blocking.
+class JobSystem
+{
+public:
+	// The thread count includes the calling thread, 0 uses every hardware thread. With 1 thread there is no worker and
+	// everything runs inline on the thread that asks.
+	explicit JobSystem(int threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem& jobSystem) = delete;
+	JobSystem& operator=(const JobSystem& jobSystem) = delete;
+
+	[[nodiscard]] int GetThreadCount() const;
+
+	// Fork and join
+	void Run(JobGroup& group, std::function<void()> job);
+	void Wait(JobGroup& group);
+
+	// Size of the ranges of ParallelFor for this many elements: about 4 ranges per thread so stealing can even out the
+	// load, but never under minGrain elements, below which a job costs more than it saves
+	[[nodiscard]] std::size_t GrainSize(std::size_t count, std::size_t minGrain) const;
+
+	// Calls body(first, last) on the ranges [k * grain, (k + 1) * grain) covering [0, count), returns once all are done.
+	// The ranges only depend on the grain, a body writing its results at first / grain gives the same results in the same
+	// order on any number of threads.
+	template <typename Body>
+	void ParallelFor(std::size_t count, std::size_t grain, const Body& body);
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobGroup* group;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	[[nodiscard]] std::size_t CurrentWorker() const;
+	bool PopOrSteal(std::size_t index, Job& outJob);
+	void WorkerLoop(std::size_t index);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::vector<std::thread> m_threads;
+
+	// Idle workers sleep until a job is queued
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	std::atomic<int> m_queued{0};
+	bool m_isStopping = false;
+};
+
+template <typename Body>
+void JobSystem::ParallelFor(const std::size_t count, const std::size_t grain, const Body& body)
+{
+	const std::size_t rangeCount = (count + grain - 1) / grain;
+	if (m_threads.empty() || rangeCount <= 1)
+	{
+		for (std::size_t range = 0; range < rangeCount; range++)
+			body(range * grain, std::min(count, (range + 1) * grain));
+
+		return;
+	}
+
+	// Each job keeps halving its ranges and queues the upper half, so idle threads steal large blocks first
+	JobGroup group;
+	std::function<void(std::size_t, std::size_t)> split = [&](std::size_t firstRange, std::size_t lastRange)
+	{
+		while (lastRange - firstRange > 1)
+		{
+			const std::size_t middle = firstRange + (lastRange - firstRange) / 2;
+			Run(group, [&split, middle, lastRange] { split(middle, lastRange); });
+			lastRange = middle;
+		}
+
+		body(firstRange * grain, std::min(count, (firstRange + 1) * grain));
+	};
+
+	split(0, rangeCount);
+	Wait(group);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	bool Open(const std::string& path);
+	void Close();
+
+	[[nodiscard]] const unsigned char* Data() const
+	{
+		return m_data;
+	}
+
+	[[nodiscard]] std::size_t Size() const
+	{
+		return m_size;
+	}
+
+	MappedFile(MappedFile& file) = delete;
+	MappedFile(MappedFile&& file) = delete;
+	MappedFile& operator=(const MappedFile& file) = delete;
+	MappedFile& operator=(MappedFile&& file) = delete;
+
+private:
+	const unsigned char* m_data = nullptr;
+	std::size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
@@ -0,0 +1,80 @@
+#include "BitStream.h"
+
+namespace
+{
+	// Signed values are written as a 2 bit size class followed by the zigzag value
+	constexpr int SIZE_CLASS_BITS[4] = {4, 10, 18, 32};
+}
+
+BitWriter::BitWriter(std::vector<uint8_t>& buffer) : m_buffer(buffer) {}
+
+void BitWriter::Write(const uint32_t value, const int bits)
+{
+	const uint64_t mask = bits == 32 ? 0xFFFFFFFFULL : (1ULL << bits) - 1;
+	m_scratch |= (value & mask) << m_scratchBits;
+	m_scratchBits += bits;
+	m_bitsWritten += bits;
+
+	while (m_scratchBits >= 8)
+	{
+		m_buffer.push_back(static_cast<uint8_t>(m_scratch & 0xFF));
+		m_scratch >>= 8;
+		m_scratchBits -= 8;
+	}
+}
+
+void BitWriter::WriteSigned(const int32_t value)
+{
+	const uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+
+	int sizeClass = 0;
+	while (sizeClass < 3 && zigzag >= (1ULL << SIZE_CLASS_BITS[sizeClass]))
+		sizeClass++;
+
+	Write(static_cast<uint32_t>(sizeClass), 2);
+	Write(zigzag, SIZE_CLASS_BITS[sizeClass]);
+}
+
+void BitWriter::Flush()
+{
+	if (m_scratchBits > 0)
+	{
+		m_buffer.push_back(static_cast<uint8_t>(m_scratch & 0xFF));
+		m_scratch = 0;
+		m_scratchBits = 0;
+	}
+}
+
+std::size_t BitWriter::BitsWritten() const
+{
+	return m_bitsWritten;
+}
+
+BitReader::BitReader(const uint8_t* data, const std::size_t size) : m_data(data), m_size(size) {}
+
+bool BitReader::Read(uint32_t& value, const int bits)
+{
+	if (m_bitsRead + bits > m_size * 8)
+		return false;
+
+	value = 0;
+	for (int i = 0; i < bits; i++)
+	{
+		const std::size_t bit = m_bitsRead + i;
+		value |= static_cast<uint32_t>((m_data[bit / 8] >> (bit % 8)) & 1) << i;
+	}
+
+	m_bitsRead += bits;
+	return true;
+}
+
+bool BitReader::ReadSigned(int32_t& value)
+{
+	uint32_t sizeClass;
+	uint32_t zigzag;
+	if (Read(sizeClass, 2) == false || Read(zigzag, SIZE_CLASS_BITS[sizeClass]) == false)
+		return false;
+
+	value = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+	return true;
+}
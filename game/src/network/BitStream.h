@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Packs values of arbitrary bit width into a byte buffer, least significant bits first
+class BitWriter
+{
+public:
+	explicit BitWriter(std::vector<uint8_t>& buffer);
+
+	void Write(uint32_t value, int bits);
+	void WriteSigned(int32_t value); // Zigzag encoded, small magnitudes use fewer bits
+	void Flush();
+
+	[[nodiscard]] std::size_t BitsWritten() const;
+
+private:
+	std::vector<uint8_t>& m_buffer;
+	uint64_t m_scratch = 0;
+	int m_scratchBits = 0;
+	std::size_t m_bitsWritten = 0;
+};
+
+class BitReader
+{
+public:
+	BitReader(const uint8_t* data, std::size_t size);
+
+	// Returns false once the reader tried to read past the end of the buffer
+	bool Read(uint32_t& value, int bits);
+	bool ReadSigned(int32_t& value);
+
+private:
+	const uint8_t* m_data;
+	std::size_t m_size;
+	std::size_t m_bitsRead = 0;
+};
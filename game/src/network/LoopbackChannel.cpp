@@ -0,0 +1,43 @@
+#include "LoopbackChannel.h"
+
+LoopbackChannel::LoopbackChannel(const float lossRate, const int latencyTicks, const uint32_t seed)
+	: m_lossRate(lossRate), m_latencyTicks(latencyTicks), m_random(seed)
+{}
+
+void LoopbackChannel::Send(const std::vector<uint8_t>& packet)
+{
+	m_packetsSent++;
+
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	if (distribution(m_random) < m_lossRate)
+	{
+		m_packetsLost++;
+		return;
+	}
+
+	m_inFlight.push_back({m_tick + m_latencyTicks, packet});
+}
+
+std::vector<std::vector<uint8_t>> LoopbackChannel::Tick()
+{
+	m_tick++;
+
+	std::vector<std::vector<uint8_t>> arrived;
+	while (m_inFlight.empty() == false && m_inFlight.front().arrivalTick <= m_tick)
+	{
+		arrived.push_back(std::move(m_inFlight.front().packet));
+		m_inFlight.pop_front();
+	}
+
+	return arrived;
+}
+
+uint64_t LoopbackChannel::PacketsSent() const
+{
+	return m_packetsSent;
+}
+
+uint64_t LoopbackChannel::PacketsLost() const
+{
+	return m_packetsLost;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+// In-process packet channel with simulated loss and latency, used to exercise replication without sockets
+class LoopbackChannel
+{
+public:
+	LoopbackChannel(float lossRate, int latencyTicks, uint32_t seed = 1);
+
+	void Send(const std::vector<uint8_t>& packet);
+
+	// Moves the channel one tick forward and returns the packets that arrived
+	std::vector<std::vector<uint8_t>> Tick();
+
+	[[nodiscard]] uint64_t PacketsSent() const;
+	[[nodiscard]] uint64_t PacketsLost() const;
+
+private:
+	struct InFlight
+	{
+		int arrivalTick;
+		std::vector<uint8_t> packet;
+	};
+
+	float m_lossRate;
+	int m_latencyTicks;
+	int m_tick = 0;
+	std::mt19937 m_random;
+	std::deque<InFlight> m_inFlight;
+
+	uint64_t m_packetsSent = 0;
+	uint64_t m_packetsLost = 0;
+};
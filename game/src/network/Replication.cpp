@@ -0,0 +1,270 @@
+#include "Replication.h"
+#include "BitStream.h"
+#include "physics/RigidBody.h"
+#include "physics/World.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+	constexpr std::size_t HISTORY_SIZE = 64;
+	constexpr std::size_t VALUES_PER_BODY = 3;
+	constexpr int32_t MAX_BODY_COUNT = 1 << 16; // Past this a packet is taken as corrupted, before its state is allocated
+	constexpr float TWO_PI = 6.28318530718f;
+
+	// True if sequence a is newer than b, handling wrap around
+	bool IsNewer(const uint16_t a, const uint16_t b)
+	{
+		return static_cast<int16_t>(a - b) > 0;
+	}
+
+	int32_t WrapRotation(const int32_t value, const int rotationBits)
+	{
+		// Keep rotation deltas in [-half turn, half turn)
+		const int32_t turn = 1 << rotationBits;
+		int32_t wrapped = value % turn;
+		if (wrapped >= turn / 2)
+			wrapped -= turn;
+		if (wrapped < -turn / 2)
+			wrapped += turn;
+		return wrapped;
+	}
+
+	void Quantize(const World& world, const ReplicationConfig& config, std::vector<int32_t>& values)
+	{
+		const auto& bodies = world.GetBodies();
+		values.resize(bodies.size() * VALUES_PER_BODY);
+
+		const float rotationScale = static_cast<float>(1 << config.rotationBits) / TWO_PI;
+		for (std::size_t i = 0; i < bodies.size(); i++)
+		{
+			const RigidBody* body = bodies[i];
+			values[i * 3 + 0] = static_cast<int32_t>(lroundf(body->m_position.x / config.positionPrecision));
+			values[i * 3 + 1] = static_cast<int32_t>(lroundf(body->m_position.y / config.positionPrecision));
+			values[i * 3 + 2] = WrapRotation(static_cast<int32_t>(lroundf(body->m_rotation * rotationScale)), config.rotationBits);
+		}
+	}
+}
+
+ReplicationServer::ReplicationServer(const ReplicationConfig& config) : m_config(config), m_history(HISTORY_SIZE) {}
+
+void ReplicationServer::Encode(const World& world, std::vector<uint8_t>& packet)
+{
+	Quantize(world, m_config, m_current);
+	const std::size_t bodyCount = m_current.size() / VALUES_PER_BODY;
+
+	// Use the newest acknowledged state as baseline if we still have it
+	const ReplicationState* baseline = nullptr;
+	if (m_hasAck)
+	{
+		const ReplicationState& state = m_history[m_ackedSequence % HISTORY_SIZE];
+		if (state.isValid && state.sequence == m_ackedSequence)
+			baseline = &state;
+	}
+
+	m_sequence++;
+	ReplicationState& sent = m_history[m_sequence % HISTORY_SIZE];
+	sent.sequence = m_sequence;
+	sent.isValid = true;
+	sent.values.assign(bodyCount * VALUES_PER_BODY, 0);
+
+	packet.clear();
+	BitWriter writer(packet);
+	writer.Write(m_sequence, 16);
+	writer.Write(baseline != nullptr ? 1 : 0, 1);
+	writer.Write(baseline != nullptr ? baseline->sequence : 0, 16);
+	writer.WriteSigned(static_cast<int32_t>(bodyCount));
+
+	const float positionThreshold = m_config.positionThreshold / m_config.positionPrecision;
+	const float rotationThreshold = m_config.rotationThreshold * static_cast<float>(1 << m_config.rotationBits) / TWO_PI;
+
+	int32_t lastIndex = -1;
+	for (std::size_t i = 0; i < bodyCount; i++)
+	{
+		const int32_t* current = &m_current[i * VALUES_PER_BODY];
+		int32_t* state = &sent.values[i * VALUES_PER_BODY];
+
+		const bool hasBaseline = baseline != nullptr && (i + 1) * VALUES_PER_BODY <= baseline->values.size();
+		if (hasBaseline)
+		{
+			const int32_t* base = &baseline->values[i * VALUES_PER_BODY];
+			const int32_t dx = current[0] - base[0];
+			const int32_t dy = current[1] - base[1];
+			const int32_t dr = WrapRotation(current[2] - base[2], m_config.rotationBits);
+
+			// Unchanged bodies keep the baseline value, which is also what the client will have
+			const bool moved = static_cast<float>(std::abs(dx)) > positionThreshold || static_cast<float>(std::abs(dy)) > positionThreshold;
+			const bool turned = static_cast<float>(std::abs(dr)) > rotationThreshold;
+			if (moved == false && turned == false)
+			{
+				state[0] = base[0];
+				state[1] = base[1];
+				state[2] = base[2];
+				continue;
+			}
+
+			writer.WriteSigned(static_cast<int32_t>(i) - lastIndex - 1);
+			writer.WriteSigned(dx);
+			writer.WriteSigned(dy);
+			writer.WriteSigned(dr);
+		}
+		else
+		{
+			writer.WriteSigned(static_cast<int32_t>(i) - lastIndex - 1);
+			writer.WriteSigned(current[0]);
+			writer.WriteSigned(current[1]);
+			writer.WriteSigned(current[2]);
+		}
+
+		state[0] = current[0];
+		state[1] = current[1];
+		state[2] = current[2];
+		lastIndex = static_cast<int32_t>(i);
+		m_bodiesSent++;
+	}
+
+	// A negative gap marks the end of the entries
+	writer.WriteSigned(-1);
+	writer.Flush();
+
+	m_ticks++;
+	m_bytesSent += packet.size();
+}
+
+void ReplicationServer::Acknowledge(const uint16_t sequence)
+{
+	if (m_hasAck == false || IsNewer(sequence, m_ackedSequence))
+	{
+		m_ackedSequence = sequence;
+		m_hasAck = true;
+	}
+}
+
+float ReplicationServer::GetAverageBytesPerTick() const
+{
+	return m_ticks > 0 ? static_cast<float>(m_bytesSent) / static_cast<float>(m_ticks) : 0.0f;
+}
+
+float ReplicationServer::GetAverageBodiesPerTick() const
+{
+	return m_ticks > 0 ? static_cast<float>(m_bodiesSent) / static_cast<float>(m_ticks) : 0.0f;
+}
+
+ReplicationClient::ReplicationClient(const ReplicationConfig& config) : m_config(config), m_history(HISTORY_SIZE) {}
+
+bool ReplicationClient::Decode(const std::vector<uint8_t>& packet, World& mirror)
+{
+	BitReader reader(packet.data(), packet.size());
+
+	uint32_t sequence, hasBaseline, baselineSequence;
+	int32_t bodyCount;
+	if (reader.Read(sequence, 16) == false || reader.Read(hasBaseline, 1) == false || reader.Read(baselineSequence, 16) == false)
+		return false;
+	if (reader.ReadSigned(bodyCount) == false || bodyCount < 0 || bodyCount > MAX_BODY_COUNT)
+		return false;
+
+	const ReplicationState* baseline = nullptr;
+	if (hasBaseline != 0)
+	{
+		baseline = &m_history[baselineSequence % HISTORY_SIZE];
+		if (baseline->isValid == false || baseline->sequence != baselineSequence)
+			return false;
+	}
+
+	// Start from the baseline, then overwrite the bodies that are in the packet
+	ReplicationState state;
+	state.sequence = static_cast<uint16_t>(sequence);
+	state.values.assign(static_cast<std::size_t>(bodyCount) * VALUES_PER_BODY, 0);
+	if (baseline != nullptr)
+	{
+		const std::size_t count = std::min(state.values.size(), baseline->values.size());
+		std::copy_n(baseline->values.begin(), count, state.values.begin());
+	}
+
+	int32_t index = -1;
+	while (true)
+	{
+		int32_t gap;
+		if (reader.ReadSigned(gap) == false)
+			return false;
+		if (gap < 0)
+			break;
+
+		// The gap comes off the wire, checked before it can overflow the index
+		if (gap >= bodyCount - index - 1)
+			return false;
+
+		index += gap + 1;
+
+		int32_t values[VALUES_PER_BODY];
+		for (auto& value : values)
+		{
+			if (reader.ReadSigned(value) == false)
+				return false;
+		}
+
+		int32_t* target = &state.values[static_cast<std::size_t>(index) * VALUES_PER_BODY];
+		const bool isDelta = baseline != nullptr && static_cast<std::size_t>(index + 1) * VALUES_PER_BODY <= baseline->values.size();
+		if (isDelta)
+		{
+			target[0] += values[0];
+			target[1] += values[1];
+			target[2] = WrapRotation(target[2] + values[2], m_config.rotationBits);
+		}
+		else
+		{
+			target[0] = values[0];
+			target[1] = values[1];
+			target[2] = values[2];
+		}
+	}
+
+	state.isValid = true;
+	const bool isNewest = m_applied.isValid == false || IsNewer(state.sequence, m_applied.sequence);
+	if (isNewest)
+		Apply(state, mirror);
+
+	m_history[state.sequence % HISTORY_SIZE] = std::move(state);
+	m_lastDecoded = static_cast<uint16_t>(sequence);
+
+	return true;
+}
+
+uint16_t ReplicationClient::GetLastDecoded() const
+{
+	return m_lastDecoded;
+}
+
+void ReplicationClient::Apply(const ReplicationState& state, World& mirror)
+{
+	auto& bodies = mirror.GetBodies();
+	const std::size_t bodyCount = std::min(bodies.size(), state.values.size() / VALUES_PER_BODY);
+	const float rotationScale = TWO_PI / static_cast<float>(1 << m_config.rotationBits);
+
+	// Only touch the bodies whose transform changed since the last applied state.
+	// The previous transform lets the mirror render in between two received states.
+	for (std::size_t i = 0; i < bodyCount; i++)
+	{
+		RigidBody* body = bodies[i];
+		body->SavePreviousTransform();
+
+		const int32_t* values = &state.values[i * VALUES_PER_BODY];
+		if (m_applied.isValid && (i + 1) * VALUES_PER_BODY <= m_applied.values.size())
+		{
+			const int32_t* applied = &m_applied.values[i * VALUES_PER_BODY];
+			if (values[0] == applied[0] && values[1] == applied[1] && values[2] == applied[2])
+				continue;
+		}
+
+		body->m_position = Vec2(static_cast<float>(values[0]) * m_config.positionPrecision, static_cast<float>(values[1]) * m_config.positionPrecision);
+		body->m_rotation = static_cast<float>(values[2]) * rotationScale;
+		body->m_shape->UpdateVertices(body->m_position, body->m_rotation);
+		body->UpdateBoundingRadius();
+	}
+
+	m_applied.sequence = state.sequence;
+	m_applied.isValid = true;
+	m_applied.values = state.values;
+}
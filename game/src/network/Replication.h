@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class World;
+
+struct ReplicationConfig
+{
+	float positionPrecision = 0.05f; // World units per quantization step
+	int rotationBits = 12; // Bits used for a full turn
+	float positionThreshold = 0.25f; // A body is sent when it moved further than this since the baseline...
+	float rotationThreshold = 0.01f; // ...or turned more than this (radians)
+};
+
+// Quantized transform of every body for one sequence
+struct ReplicationState
+{
+	uint16_t sequence = 0;
+	bool isValid = false;
+	std::vector<int32_t> values; // x, y, rotation per body
+};
+
+// Server side: writes one packet per tick with the bodies that changed since the newest state the client acknowledged.
+// Packet layout: sequence (16) | has baseline (1) | baseline sequence (16) | body count (signed) | entries | end marker
+// Entry: body index gap (signed) | x, y and rotation deltas against the baseline (signed)
+// The client drops packets of more than 65536 bodies as corrupted.
+class ReplicationServer
+{
+public:
+	explicit ReplicationServer(const ReplicationConfig& config = ReplicationConfig());
+
+	void Encode(const World& world, std::vector<uint8_t>& packet);
+	void Acknowledge(uint16_t sequence);
+
+	[[nodiscard]] float GetAverageBytesPerTick() const;
+	[[nodiscard]] float GetAverageBodiesPerTick() const;
+
+private:
+	ReplicationConfig m_config;
+	std::vector<ReplicationState> m_history;
+	std::vector<int32_t> m_current;
+	uint16_t m_sequence = 0;
+	uint16_t m_ackedSequence = 0;
+	bool m_hasAck = false;
+
+	uint64_t m_ticks = 0;
+	uint64_t m_bytesSent = 0;
+	uint64_t m_bodiesSent = 0;
+};
+
+// Client side: rebuilds the server state from the packets and moves the bodies of a mirror world
+class ReplicationClient
+{
+public:
+	explicit ReplicationClient(const ReplicationConfig& config = ReplicationConfig());
+
+	// Returns false if the packet is corrupted or its baseline is unknown. Older packets are kept as baselines but not applied.
+	bool Decode(const std::vector<uint8_t>& packet, World& mirror);
+
+	// Sequence to acknowledge back to the server after a successful decode
+	[[nodiscard]] uint16_t GetLastDecoded() const;
+
+private:
+	void Apply(const ReplicationState& state, World& mirror);
+
+	ReplicationConfig m_config;
+	std::vector<ReplicationState> m_history;
+	ReplicationState m_applied;
+	uint16_t m_lastDecoded = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Vec2.h"
+
+// Axis aligned bounding box in world space
+struct AABB
+{
+	Vec2 min;
+	Vec2 max;
+
+	[[nodiscard]] bool Overlaps(const AABB& other) const
+	{
+		return min.x <= other.max.x && other.min.x <= max.x && min.y <= other.max.y && other.min.y <= max.y;
+	}
+
+	[[nodiscard]] bool Contains(const Vec2& point) const
+	{
+		return point.x >= min.x && point.x <= max.x && point.y >= min.y && point.y <= max.y;
+	}
+
+	[[nodiscard]] AABB Union(const AABB& other) const
+	{
+		return {Vec2(std::min(min.x, other.min.x), std::min(min.y, other.min.y)), Vec2(std::max(max.x, other.max.x), std::max(max.y, other.max.y))};
+	}
+
+	[[nodiscard]] AABB Expanded(const float margin) const
+	{
+		return {Vec2(min.x - margin, min.y - margin), Vec2(max.x + margin, max.y + margin)};
+	}
+
+	// Slab test of the segment from start to end
+	[[nodiscard]] bool IntersectsSegment(const Vec2& start, const Vec2& end) const
+	{
+		float lower = 0.0f;
+		float upper = 1.0f;
+		const float starts[2] = {start.x, start.y};
+		const float deltas[2] = {end.x - start.x, end.y - start.y};
+		const float mins[2] = {min.x, min.y};
+		const float maxs[2] = {max.x, max.y};
+
+		for (int axis = 0; axis < 2; axis++)
+		{
+			if (deltas[axis] == 0.0f)
+			{
+				if (starts[axis] < mins[axis] || starts[axis] > maxs[axis])
+					return false;
+
+				continue;
+			}
+
+			const float inverse = 1.0f / deltas[axis];
+			const float t0 = (mins[axis] - starts[axis]) * inverse;
+			const float t1 = (maxs[axis] - starts[axis]) * inverse;
+			lower = std::max(lower, std::min(t0, t1));
+			upper = std::min(upper, std::max(t0, t1));
+			if (lower > upper)
+				return false;
+		}
+
+		return true;
+	}
+
+	[[nodiscard]] Vec2 Center() const
+	{
+		return Vec2((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f);
+	}
+};
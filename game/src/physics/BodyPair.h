@@ -0,0 +1,11 @@
+#pragma once
+
+class RigidBody;
+
+// Pair of bodies that passed the broad phase, with the distance at which the narrow phase also reports speculative contacts
+struct BodyPair
+{
+	RigidBody* a;
+	RigidBody* b;
+	float speculativeDistance;
+};
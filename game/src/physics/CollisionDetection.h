@@ -1,7 +1,16 @@
 #pragma once
 
+#include "BodyPair.h"
+#include "Distance.h"
 #include "RigidBody.h"
+#include "SatCache.h"
 #include "physics/Shape.h"
+#include "physics/Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 struct Contact
 {
@@ -15,13 +24,14 @@ struct Contact
 	float depth;
 };
 
-inline bool IsCollidingCircleCircle(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts)
+// The speculative distance also reports the pairs that are still apart by less than that distance, with a negative depth
+inline bool IsCollidingCircleCircle(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f)
 {
 	const CircleShape* aCircleShape = dynamic_cast<CircleShape*>(a->m_shape.get());
 	const CircleShape* bCircleShape = dynamic_cast<CircleShape*>(b->m_shape.get());
 
 	const Vec2 ab = b->m_position - a->m_position;
-	const float radiusSum = aCircleShape->m_radius + bCircleShape->m_radius;
+	const float radiusSum = aCircleShape->m_radius + bCircleShape->m_radius + speculativeDistance;
 
 	const bool isColliding = ab.MagnitudeSquared() <= (radiusSum * radiusSum);
 
@@ -34,13 +44,84 @@ inline bool IsCollidingCircleCircle(RigidBody* a, RigidBody* b, std::vector<Cont
 	contact.normal = ab.Normalized();
 	contact.start = b->m_position - contact.normal * bCircleShape->m_radius;
 	contact.end = a->m_position + contact.normal * aCircleShape->m_radius;
-	contact.depth = (contact.end - contact.start).Magnitude();
+	contact.depth = (contact.end - contact.start).Dot(contact.normal);
 
 	outContacts.push_back(contact);
 
 	return true;
 }
 
+// Same test as IsCollidingCircleCircle on a whole batch of circle pairs, 4 at a time. The radius is read from the bounding
+// radius of the bodies, which is the circle radius.
+inline void IsCollidingCircleCircleBatch(const BodyPair* pairs, const std::size_t count, std::vector<Contact>& outContacts)
+{
+	const auto addContact = [&outContacts](const BodyPair& pair, const Vec2& normal)
+	{
+		Contact contact;
+		contact.a = pair.a;
+		contact.b = pair.b;
+		contact.normal = normal;
+		contact.start = pair.b->m_position - normal * pair.b->m_radius;
+		contact.end = pair.a->m_position + normal * pair.a->m_radius;
+		contact.depth = (contact.end - contact.start).Dot(contact.normal);
+		outContacts.push_back(contact);
+	};
+
+	std::size_t i = 0;
+
+#ifdef PHYSICS_USE_SSE2
+	alignas(16) float ax[4], ay[4], bx[4], by[4], radiusSum[4];
+	alignas(16) float nx[4], ny[4];
+
+	for (; i + 4 <= count; i += 4)
+	{
+		// Gather the 4 pairs
+		for (std::size_t lane = 0; lane < 4; lane++)
+		{
+			const BodyPair& pair = pairs[i + lane];
+			ax[lane] = pair.a->m_position.x;
+			ay[lane] = pair.a->m_position.y;
+			bx[lane] = pair.b->m_position.x;
+			by[lane] = pair.b->m_position.y;
+			radiusSum[lane] = pair.a->m_radius + pair.b->m_radius + pair.speculativeDistance;
+		}
+
+		const __m128 dx = _mm_sub_ps(_mm_load_ps(bx), _mm_load_ps(ax));
+		const __m128 dy = _mm_sub_ps(_mm_load_ps(by), _mm_load_ps(ay));
+		const __m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		const __m128 sum = _mm_load_ps(radiusSum);
+
+		const int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_mul_ps(sum, sum)));
+		if (mask == 0)
+			continue;
+
+		// Normalize, leaving a zero normal for the circles exactly on top of each other like Normalized does
+		const __m128 distance = _mm_sqrt_ps(distanceSquared);
+		const __m128 isZero = _mm_cmpeq_ps(distance, _mm_setzero_ps());
+		const __m128 safeDistance = _mm_or_ps(_mm_and_ps(isZero, _mm_set1_ps(1.0f)), _mm_andnot_ps(isZero, distance));
+		_mm_store_ps(nx, _mm_andnot_ps(isZero, _mm_div_ps(dx, safeDistance)));
+		_mm_store_ps(ny, _mm_andnot_ps(isZero, _mm_div_ps(dy, safeDistance)));
+
+		// Only store the contacts of the colliding lanes
+		for (std::size_t lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+				addContact(pairs[i + lane], Vec2(nx[lane], ny[lane]));
+		}
+	}
+#endif
+
+	// Pairs left out of the batches
+	for (; i < count; i++)
+	{
+		const BodyPair& pair = pairs[i];
+		const Vec2 ab = pair.b->m_position - pair.a->m_position;
+		const float radiusSum = pair.a->m_radius + pair.b->m_radius + pair.speculativeDistance;
+		if (ab.MagnitudeSquared() <= radiusSum * radiusSum)
+			addContact(pair, ab.Normalized());
+	}
+}
+
 inline bool BroadPhaseCollisionCheck(const Vec2& posA, const float radiusA, const Vec2& posB, const float radiusB)
 {
 	const Vec2 ab = posB - posA;
@@ -48,44 +129,104 @@ inline bool BroadPhaseCollisionCheck(const Vec2& posA, const float radiusA, cons
 	return ab.MagnitudeSquared() <= (radiusSum * radiusSum);
 }
 
-inline bool IsCollidingPolygonPolygon(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts)
+inline bool BroadPhaseCollisionCheck(const AABB& boxA, const AABB& boxB)
+{
+	return boxA.Overlaps(boxB);
+}
+
+// With a cache, the axis found on the last step is tested first and full SAT only runs when it can not be used
+inline bool IsCollidingPolygonPolygon(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f,
+                                      SatCache* cache = nullptr, bool* outCacheHit = nullptr)
 {
 	const PolygonShape* aPolygonShape = dynamic_cast<PolygonShape*>(a->m_shape.get());
 	const PolygonShape* bPolygonShape = dynamic_cast<PolygonShape*>(b->m_shape.get());
 
-	int aIndexReferenceEdge, bIndexReferenceEdge;
-	Vec2 aSupportPoint, bSupportPoint;
+	// Position and rotation of b in the frame of a, every SAT separation only depends on them
+	const Vec2 relativePosition = (b->m_position - a->m_position).Rotate(-a->m_rotation);
+	const float relativeRotation = b->m_rotation - a->m_rotation;
 
-	const float abSeparation = aPolygonShape->FindMinSeparation(bPolygonShape, aIndexReferenceEdge, aSupportPoint);
-	if (abSeparation >= 0)
-		return false;
+	bool isReferenceA = false;
+	size_t indexReferenceEdge = 0;
+	bool isCached = false;
 
-	const float baSeparation = bPolygonShape->FindMinSeparation(aPolygonShape, bIndexReferenceEdge, bSupportPoint);
-	if (baSeparation >= 0)
-		return false;
+	if (cache != nullptr && cache->isValid)
+	{
+		const PolygonShape* edgeShape = cache->isEdgeOfA ? aPolygonShape : bPolygonShape;
+		const PolygonShape* otherShape = cache->isEdgeOfA ? bPolygonShape : aPolygonShape;
 
-	const PolygonShape* referenceShape;
-	const PolygonShape* incidentShape;
-	size_t indexReferenceEdge;
+		if (cache->isSeparating)
+		{
+			if (edgeShape->FindEdgeSeparation(otherShape, cache->edge) >= speculativeDistance)
+			{
+				if (outCacheHit != nullptr)
+					*outCacheHit = true;
 
-	if (abSeparation > baSeparation)
-	{
-		referenceShape = aPolygonShape;
-		incidentShape = bPolygonShape;
-		indexReferenceEdge = aIndexReferenceEdge;
+				return false;
+			}
+		}
+		else
+		{
+			// No separation changes by more than this since the reference edge was found
+			const float rotationChange = std::abs(relativeRotation - cache->relativeRotation);
+			const float motionBound = (relativePosition - cache->relativePosition).Magnitude() +
+				rotationChange * (cache->relativePosition.Magnitude() + a->m_radius + b->m_radius);
+
+			// None of the other axes can separate the pair or get too far ahead of the edge
+			if (2.0f * motionBound < cache->lead + SAT_CACHE_TOLERANCE && cache->separation + motionBound < speculativeDistance)
+			{
+				isReferenceA = cache->isEdgeOfA;
+				indexReferenceEdge = cache->edge;
+				isCached = true;
+			}
+		}
 	}
-	else
+
+	if (outCacheHit != nullptr)
+		*outCacheHit = isCached;
+
+	if (isCached == false)
 	{
-		referenceShape = bPolygonShape;
-		incidentShape = aPolygonShape;
-		indexReferenceEdge = bIndexReferenceEdge;
+		int aIndexReferenceEdge, bIndexReferenceEdge;
+		Vec2 aSupportPoint, bSupportPoint;
+		float abNextSeparation, baNextSeparation;
+
+		const float abSeparation = aPolygonShape->FindMinSeparation(bPolygonShape, aIndexReferenceEdge, aSupportPoint, abNextSeparation);
+		if (abSeparation >= speculativeDistance)
+		{
+			if (cache != nullptr)
+				*cache = {true, true, true, aIndexReferenceEdge, 0.0f, 0.0f, Vec2(), 0.0f};
+
+			return false;
+		}
+
+		const float baSeparation = bPolygonShape->FindMinSeparation(aPolygonShape, bIndexReferenceEdge, bSupportPoint, baNextSeparation);
+		if (baSeparation >= speculativeDistance)
+		{
+			if (cache != nullptr)
+				*cache = {true, true, false, bIndexReferenceEdge, 0.0f, 0.0f, Vec2(), 0.0f};
+
+			return false;
+		}
+
+		isReferenceA = abSeparation > baSeparation;
+		indexReferenceEdge = isReferenceA ? aIndexReferenceEdge : bIndexReferenceEdge;
+
+		if (cache != nullptr)
+		{
+			const float separation = isReferenceA ? abSeparation : baSeparation;
+			const float lead = separation - std::max({abNextSeparation, baNextSeparation, isReferenceA ? baSeparation : abSeparation});
+			*cache = {true, false, isReferenceA, static_cast<int>(indexReferenceEdge), separation, lead, relativePosition, relativeRotation};
+		}
 	}
 
+	const PolygonShape* referenceShape = isReferenceA ? aPolygonShape : bPolygonShape;
+	const PolygonShape* incidentShape = isReferenceA ? bPolygonShape : aPolygonShape;
+
 	// Find the reference edge based on the index that returned from the function
-	const Vec2 referenceEdge = referenceShape->EdgeAt(indexReferenceEdge);
+	const Vec2 referenceNormal = referenceShape->NormalAt(indexReferenceEdge);
 
 	// Clipping 
-	const auto incidentIndex = incidentShape->FindIncidentEdge(referenceEdge.Perpendicular());
+	const auto incidentIndex = incidentShape->FindIncidentEdge(referenceNormal);
 	const auto incidentNextIndex = (incidentIndex + 1) % incidentShape->m_worldVertices.size();
 	const Vec2 v0 = incidentShape->m_worldVertices[incidentIndex];
 	const Vec2 v1 = incidentShape->m_worldVertices[incidentNextIndex];
@@ -112,17 +253,18 @@ inline bool IsCollidingPolygonPolygon(RigidBody* a, RigidBody* b, std::vector<Co
 	// Loop all clipped points, but only consider those where separation is negative (objects are penetrating each other)
 	for (const auto& vclip : clippedPoints)
 	{
-		const float separation = (vclip - vref).Dot(referenceEdge.Perpendicular());
-		if (separation <= 0)
+		const float separation = (vclip - vref).Dot(referenceNormal);
+		if (separation <= speculativeDistance)
 		{
 			Contact contact;
 			contact.a = a;
 			contact.b = b;
-			contact.normal = referenceEdge.Perpendicular();
+			contact.normal = referenceNormal;
 			contact.start = vclip;
 			contact.end = vclip + contact.normal * -separation;
+			contact.depth = -separation;
 
-			if (baSeparation >= abSeparation)
+			if (isReferenceA == false)
 			{
 				std::swap(contact.start, contact.end); // The start-end points are always from "a" to "b"
 				contact.normal *= -1.0; // The collision normal is always from "a" to "b"
@@ -134,7 +276,7 @@ inline bool IsCollidingPolygonPolygon(RigidBody* a, RigidBody* b, std::vector<Co
 	return true;
 }
 
-inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std::vector<Contact>& outContacts)
+inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f)
 {
 	const PolygonShape* polygonShape = dynamic_cast<PolygonShape*>(polygon->m_shape.get());
 	const CircleShape* circleShape = dynamic_cast<CircleShape*>(circle->m_shape.get());
@@ -149,8 +291,7 @@ inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std:
 	{
 		const auto currVertex = i;
 		const auto nextVertex = (i + 1) % polygonVertices.size();
-		Vec2 edge = polygonShape->EdgeAt(currVertex);
-		Vec2 normal = edge.Perpendicular();
+		Vec2 normal = polygonShape->NormalAt(currVertex);
 
 		// Compare the circle center with the polygon vertex
 		Vec2 circleCenter = circle->m_position - polygonVertices[currVertex];
@@ -189,7 +330,7 @@ inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std:
 		{
 			// Distance from vertex to circle center is greater than radius... no collision
 			const float magnitude = v1.Magnitude();
-			if (magnitude > circleShape->m_radius)
+			if (magnitude > circleShape->m_radius + speculativeDistance)
 				return false;
 
 			// Detected collision in region A:
@@ -207,7 +348,7 @@ inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std:
 			{
 				// Distance from vertex to circle center is greater than radius... no collision
 				const float magnitude = v1.Magnitude();
-				if (magnitude > circleShape->m_radius)
+				if (magnitude > circleShape->m_radius + speculativeDistance)
 					return false;
 
 				// Detected collision in region B:
@@ -219,7 +360,7 @@ inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std:
 			else
 			{
 				// We are inside region C:
-				if (distanceCircleEdge > circleShape->m_radius)
+				if (distanceCircleEdge > circleShape->m_radius + speculativeDistance)
 					// No collision... Distance between the closest distance and the circle center is greater than the radius.
 					return false;
 
@@ -245,7 +386,216 @@ inline bool IsCollidingPolygonCircle(RigidBody* polygon, RigidBody* circle, std:
 	return true;
 }
 
-inline bool IsColliding(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts)
+// Any pair of convex shapes: GJK gives the closest points of the cores (vertices without radius), EPA their deepest points
+// when the cores overlap. Always a single contact point.
+inline bool IsCollidingConvex(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f)
+{
+	const ConvexProxy aProxy = a->m_shape->GetProxy();
+	const ConvexProxy bProxy = b->m_shape->GetProxy();
+
+	Contact contact;
+	contact.a = a;
+	contact.b = b;
+
+	Vec2 aPoint, bPoint;
+	const DistanceOutput distance = ComputeDistance(aProxy, bProxy);
+	if (distance.isOverlapping == false)
+	{
+		if (distance.distance >= aProxy.radius + bProxy.radius + speculativeDistance)
+			return false;
+
+		contact.normal = (distance.pointB - distance.pointA) / distance.distance;
+		aPoint = distance.pointA;
+		bPoint = distance.pointB;
+	}
+	else
+	{
+		PenetrationOutput penetration;
+		if (ComputePenetration(aProxy, bProxy, penetration) == false)
+			return false;
+
+		contact.normal = penetration.normal;
+		aPoint = penetration.pointA;
+		bPoint = penetration.pointB;
+	}
+
+	contact.start = bPoint - contact.normal * bProxy.radius;
+	contact.end = aPoint + contact.normal * aProxy.radius;
+	contact.depth = (contact.end - contact.start).Dot(contact.normal);
+
+	outContacts.push_back(contact);
+	return true;
+}
+
+// Fast path for a capsule or segment against a circle: the closest point of the segment to the circle center
+inline bool IsCollidingCapsuleCircle(RigidBody* capsule, RigidBody* circle, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f)
+{
+	const CapsuleShape* capsuleShape = dynamic_cast<CapsuleShape*>(capsule->m_shape.get());
+	const CircleShape* circleShape = dynamic_cast<CircleShape*>(circle->m_shape.get());
+
+	const Vec2 p0 = capsuleShape->m_worldVertices[0];
+	const Vec2 axis = capsuleShape->m_worldVertices[1] - p0;
+	const float axisLengthSquared = axis.MagnitudeSquared();
+	const float t = axisLengthSquared > 0.0f ? std::clamp((circle->m_position - p0).Dot(axis) / axisLengthSquared, 0.0f, 1.0f) : 0.0f;
+	const Vec2 closestPoint = p0 + axis * t;
+
+	const Vec2 toCenter = circle->m_position - closestPoint;
+	const float radiusSum = capsuleShape->m_radius + circleShape->m_radius + speculativeDistance;
+	if (toCenter.MagnitudeSquared() > radiusSum * radiusSum)
+		return false;
+
+	// A center right on the segment is pushed out on the side of the capsule
+	Vec2 normal = toCenter.Normalized();
+	if (normal.MagnitudeSquared() == 0.0f)
+		normal = Vec2(-axis.y, axis.x).Normalized();
+
+	Contact contact;
+	contact.a = capsule;
+	contact.b = circle;
+	contact.normal = normal;
+	contact.start = circle->m_position - normal * circleShape->m_radius;
+	contact.end = closestPoint + normal * capsuleShape->m_radius;
+	contact.depth = (contact.end - contact.start).Dot(contact.normal);
+
+	outContacts.push_back(contact);
+	return true;
+}
+
+// Fast path for a polygon against a capsule or segment. SAT on the cores, with the radius taken off the separation: the
+// normals of the polygon and the normal of the segment. The segment clipped to the polygon face, or the incident edge of
+// the polygon clipped to the segment, gives up to two contacts, so a capsule lying on a box rests on both ends.
+// Near the rounded ends SAT may find less than the real distance, which only makes speculative contacts.
+inline bool IsCollidingPolygonCapsule(RigidBody* polygon, RigidBody* capsule, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f)
+{
+	constexpr float capsuleAxisTolerance = 0.1f; // The polygon face is kept as reference unless the capsule one is this much better
+
+	const PolygonShape* polygonShape = dynamic_cast<PolygonShape*>(polygon->m_shape.get());
+	const CapsuleShape* capsuleShape = dynamic_cast<CapsuleShape*>(capsule->m_shape.get());
+	const std::vector<Vec2>& vertices = polygonShape->m_worldVertices;
+	const Vec2 p0 = capsuleShape->m_worldVertices[0];
+	const Vec2 p1 = capsuleShape->m_worldVertices[1];
+	const float radius = capsuleShape->m_radius;
+
+	// Polygon normals
+	float polygonSeparation = std::numeric_limits<float>::lowest();
+	std::size_t polygonEdge = 0;
+	for (std::size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vec2 normal = polygonShape->NormalAt(i);
+		const float separation = std::min((p0 - vertices[i]).Dot(normal), (p1 - vertices[i]).Dot(normal)) - radius;
+		if (separation > polygonSeparation)
+		{
+			polygonSeparation = separation;
+			polygonEdge = i;
+		}
+	}
+
+	if (polygonSeparation >= speculativeDistance)
+		return false;
+
+	// Capsule normal, on the side of the polygon
+	const Vec2 axis = p1 - p0;
+	Vec2 capsuleNormal = Vec2(-axis.y, axis.x).Normalized();
+	float capsuleSeparation = std::numeric_limits<float>::lowest();
+	if (capsuleNormal.MagnitudeSquared() > 0.0f)
+	{
+		if ((polygon->m_position - p0).Dot(capsuleNormal) < 0.0f)
+			capsuleNormal *= -1.0f;
+
+		capsuleSeparation = std::numeric_limits<float>::max();
+		for (const auto& vertex : vertices)
+			capsuleSeparation = std::min(capsuleSeparation, (vertex - p0).Dot(capsuleNormal) - radius);
+
+		if (capsuleSeparation >= speculativeDistance)
+			return false;
+	}
+
+	const auto addContact = [&](const Vec2& start, const Vec2& end, const Vec2& normal)
+	{
+		Contact contact;
+		contact.a = polygon;
+		contact.b = capsule;
+		contact.normal = normal;
+		contact.start = start;
+		contact.end = end;
+		contact.depth = (end - start).Dot(normal);
+		outContacts.push_back(contact);
+	};
+
+	// Clips the segment from c0 to c1 to the slab between two points along a tangent, returns the number of points left
+	const auto clipToSlab = [](Vec2& c0, Vec2& c1, const Vec2& slabStart, const Vec2& slabEnd)
+	{
+		const Vec2 tangent = (slabEnd - slabStart).Normalized();
+		const float length = (slabEnd - slabStart).Dot(tangent);
+		const float s0 = (c0 - slabStart).Dot(tangent);
+		const float s1 = (c1 - slabStart).Dot(tangent);
+		if ((s0 < 0.0f && s1 < 0.0f) || (s0 > length && s1 > length))
+			return 0;
+
+		const Vec2 d0 = c0;
+		const Vec2 d1 = c1;
+		if (s0 != s1)
+		{
+			c0 = d0 + (d1 - d0) * ((std::clamp(s0, 0.0f, length) - s0) / (s1 - s0));
+			c1 = d0 + (d1 - d0) * ((std::clamp(s1, 0.0f, length) - s0) / (s1 - s0));
+		}
+
+		return 2;
+	};
+
+	if (capsuleSeparation <= polygonSeparation + capsuleAxisTolerance)
+	{
+		// The segment is the incident edge of the polygon face
+		const Vec2 normal = polygonShape->NormalAt(polygonEdge);
+		const Vec2& v0 = vertices[polygonEdge];
+		const Vec2& v1 = vertices[(polygonEdge + 1) % vertices.size()];
+
+		Vec2 c[2] = {p0, p1};
+		if (clipToSlab(c[0], c[1], v0, v1) == 0)
+			return false;
+
+		for (const auto& point : c)
+		{
+			const float separation = (point - v0).Dot(normal) - radius;
+			if (separation <= speculativeDistance)
+			{
+				const Vec2 start = point - normal * radius;
+				addContact(start, start - normal * separation, normal);
+			}
+		}
+	}
+	else
+	{
+		// The incident edge of the polygon against the segment
+		const int incidentEdge = polygonShape->FindIncidentEdge(capsuleNormal);
+		Vec2 c[2] = {vertices[incidentEdge], vertices[(incidentEdge + 1) % vertices.size()]};
+		if (clipToSlab(c[0], c[1], p0, p1) == 0)
+			return false;
+
+		for (const auto& point : c)
+		{
+			const float separation = (point - p0).Dot(capsuleNormal) - radius;
+			if (separation <= speculativeDistance)
+				addContact(point - capsuleNormal * separation, point, -capsuleNormal);
+		}
+	}
+
+	return true;
+}
+
+// Overlap of two shapes without the contact points, for the sensors and the shape queries: the distance between their cores
+// is below the sum of their radii
+inline bool IsOverlapping(const Shape& a, const Shape& b)
+{
+	const ConvexProxy proxyA = a.GetProxy();
+	const ConvexProxy proxyB = b.GetProxy();
+	const DistanceOutput output = ComputeDistance(proxyA, proxyB);
+	return output.isOverlapping || output.distance < proxyA.radius + proxyB.radius;
+}
+
+// The SAT cache is only used for polygon pairs, the hit flag tells whether it saved a full SAT
+inline bool IsColliding(RigidBody* a, RigidBody* b, std::vector<Contact>& outContacts, const float speculativeDistance = 0.0f,
+                        SatCache* satCache = nullptr, bool* outSatCacheHit = nullptr)
 {
 	const bool aIsCircle = a->m_shape->GetType() == CIRCLE;
 	const bool bIsCircle = b->m_shape->GetType() == CIRCLE;
@@ -254,16 +604,236 @@ inline bool IsColliding(RigidBody* a, RigidBody* b, std::vector<Contact>& outCon
 	const bool bIsPolygon = b->m_shape->GetType() == POLYGON || b->m_shape->GetType() == BOX;
 
 	if (aIsCircle && bIsCircle)
-		return IsCollidingCircleCircle(a, b, outContacts);
+		return IsCollidingCircleCircle(a, b, outContacts, speculativeDistance);
 
 	if (aIsPolygon && bIsPolygon)
-		return IsCollidingPolygonPolygon(a, b, outContacts);
+		return IsCollidingPolygonPolygon(a, b, outContacts, speculativeDistance, satCache, outSatCacheHit);
 
 	if (aIsPolygon && bIsCircle)
-		return IsCollidingPolygonCircle(a, b, outContacts);
+		return IsCollidingPolygonCircle(a, b, outContacts, speculativeDistance);
 
 	if (aIsCircle && bIsPolygon)
-		return IsCollidingPolygonCircle(b, a, outContacts);
+		return IsCollidingPolygonCircle(b, a, outContacts, speculativeDistance);
+
+	const bool aIsCapsule = a->m_shape->GetType() == CAPSULE || a->m_shape->GetType() == SEGMENT;
+	const bool bIsCapsule = b->m_shape->GetType() == CAPSULE || b->m_shape->GetType() == SEGMENT;
+
+	if (aIsPolygon && bIsCapsule)
+		return IsCollidingPolygonCapsule(a, b, outContacts, speculativeDistance);
+
+	if (aIsCapsule && bIsPolygon)
+		return IsCollidingPolygonCapsule(b, a, outContacts, speculativeDistance);
+
+	if (aIsCapsule && bIsCircle)
+		return IsCollidingCapsuleCircle(a, b, outContacts, speculativeDistance);
+
+	if (aIsCircle && bIsCapsule)
+		return IsCollidingCapsuleCircle(b, a, outContacts, speculativeDistance);
+
+	// Every other convex pair, for now capsules and segments between themselves
+	return IsCollidingConvex(a, b, outContacts, speculativeDistance);
+}
+
+// Separation of two bodies, negative when they overlap. The contact gets the closest points with the same conventions as
+// the colliding contacts (start on B's surface, end on A's surface, normal from A to B), so a separated pair can be
+// turned into a speculative contact. For polygons it is the SAT separation, which is never more than the real distance.
+inline float ComputeSeparationCircleCircle(RigidBody* a, RigidBody* b, Contact& outContact)
+{
+	const CircleShape* aCircleShape = dynamic_cast<CircleShape*>(a->m_shape.get());
+	const CircleShape* bCircleShape = dynamic_cast<CircleShape*>(b->m_shape.get());
+
+	const Vec2 ab = b->m_position - a->m_position;
+	const float distance = ab.Magnitude();
+
+	outContact.a = a;
+	outContact.b = b;
+	outContact.normal = distance > 0.0f ? ab * (1.0f / distance) : Vec2(0.0f, 1.0f);
+	outContact.start = b->m_position - outContact.normal * bCircleShape->m_radius;
+	outContact.end = a->m_position + outContact.normal * aCircleShape->m_radius;
+	outContact.depth = aCircleShape->m_radius + bCircleShape->m_radius - distance;
+
+	return -outContact.depth;
+}
+
+inline float ComputeSeparationPolygonCircle(RigidBody* polygon, RigidBody* circle, Contact& outContact)
+{
+	const PolygonShape* polygonShape = dynamic_cast<PolygonShape*>(polygon->m_shape.get());
+	const CircleShape* circleShape = dynamic_cast<CircleShape*>(circle->m_shape.get());
+	const std::vector<Vec2>& polygonVertices = polygonShape->m_worldVertices;
+
+	// Find the closest point of the polygon outline to the circle center
+	bool isInside = true;
+	float minDistanceSquared = std::numeric_limits<float>::max();
+	Vec2 closestPoint;
+	Vec2 closestEdgeNormal;
+
+	for (std::size_t i = 0; i < polygonVertices.size(); i++)
+	{
+		const Vec2& v0 = polygonVertices[i];
+		const Vec2 edge = polygonShape->EdgeAt(i);
+		if ((circle->m_position - v0).Dot(polygonShape->NormalAt(i)) > 0.0f)
+			isInside = false;
+
+		const float t = std::clamp((circle->m_position - v0).Dot(edge) / edge.MagnitudeSquared(), 0.0f, 1.0f);
+		const Vec2 point = v0 + edge * t;
+		const float distanceSquared = (circle->m_position - point).MagnitudeSquared();
+		if (distanceSquared < minDistanceSquared)
+		{
+			minDistanceSquared = distanceSquared;
+			closestPoint = point;
+			closestEdgeNormal = polygonShape->NormalAt(i);
+		}
+	}
+
+	const float distance = std::sqrt(minDistanceSquared);
+
+	outContact.a = polygon;
+	outContact.b = circle;
+	if (distance > 0.0f)
+		outContact.normal = (circle->m_position - closestPoint) * ((isInside ? -1.0f : 1.0f) / distance);
+	else
+		outContact.normal = closestEdgeNormal;
+
+	outContact.start = circle->m_position - outContact.normal * circleShape->m_radius;
+	outContact.end = closestPoint;
+	outContact.depth = circleShape->m_radius + (isInside ? distance : -distance);
+
+	return -outContact.depth;
+}
+
+inline float ComputeSeparationPolygonPolygon(RigidBody* a, RigidBody* b, Contact& outContact)
+{
+	const PolygonShape* aPolygonShape = dynamic_cast<PolygonShape*>(a->m_shape.get());
+	const PolygonShape* bPolygonShape = dynamic_cast<PolygonShape*>(b->m_shape.get());
+
+	int aIndexReferenceEdge, bIndexReferenceEdge;
+	Vec2 aSupportPoint, bSupportPoint;
+	const float abSeparation = aPolygonShape->FindMinSeparation(bPolygonShape, aIndexReferenceEdge, aSupportPoint);
+	const float baSeparation = bPolygonShape->FindMinSeparation(aPolygonShape, bIndexReferenceEdge, bSupportPoint);
+
+	outContact.a = a;
+	outContact.b = b;
+
+	if (abSeparation >= baSeparation)
+	{
+		// A's edge separates them best, the closest point of B is its support point
+		outContact.normal = aPolygonShape->NormalAt(aIndexReferenceEdge);
+		outContact.start = aSupportPoint;
+		outContact.end = aSupportPoint - outContact.normal * abSeparation;
+		outContact.depth = -abSeparation;
+	}
+	else
+	{
+		const Vec2 bNormal = bPolygonShape->NormalAt(bIndexReferenceEdge);
+		outContact.normal = bNormal * -1.0f;
+		outContact.start = bSupportPoint - bNormal * baSeparation;
+		outContact.end = bSupportPoint;
+		outContact.depth = -baSeparation;
+	}
+
+	return -outContact.depth;
+}
+
+// Any pair of convex shapes, the GJK distance
+inline float ComputeSeparationConvex(RigidBody* a, RigidBody* b, Contact& outContact)
+{
+	const ConvexProxy aProxy = a->m_shape->GetProxy();
+	const ConvexProxy bProxy = b->m_shape->GetProxy();
+
+	outContact.a = a;
+	outContact.b = b;
+
+	Vec2 aPoint, bPoint;
+	const DistanceOutput distance = ComputeDistance(aProxy, bProxy);
+	if (distance.isOverlapping == false && distance.distance > 0.0f)
+	{
+		outContact.normal = (distance.pointB - distance.pointA) / distance.distance;
+		aPoint = distance.pointA;
+		bPoint = distance.pointB;
+	}
+	else
+	{
+		PenetrationOutput penetration{};
+		ComputePenetration(aProxy, bProxy, penetration);
+		outContact.normal = penetration.normal;
+		aPoint = penetration.pointA;
+		bPoint = penetration.pointB;
+	}
+
+	outContact.start = bPoint - outContact.normal * bProxy.radius;
+	outContact.end = aPoint + outContact.normal * aProxy.radius;
+	outContact.depth = (outContact.end - outContact.start).Dot(outContact.normal);
+
+	return -outContact.depth;
+}
+
+inline float ComputeSeparation(RigidBody* a, RigidBody* b, Contact& outContact)
+{
+	const ShapeType aType = a->m_shape->GetType();
+	const ShapeType bType = b->m_shape->GetType();
+	if (aType == CAPSULE || aType == SEGMENT || bType == CAPSULE || bType == SEGMENT)
+		return ComputeSeparationConvex(a, b, outContact);
+
+	const bool aIsCircle = aType == CIRCLE;
+	const bool bIsCircle = bType == CIRCLE;
+
+	if (aIsCircle && bIsCircle)
+		return ComputeSeparationCircleCircle(a, b, outContact);
+
+	if (aIsCircle == false && bIsCircle == false)
+		return ComputeSeparationPolygonPolygon(a, b, outContact);
+
+	if (bIsCircle)
+		return ComputeSeparationPolygonCircle(a, b, outContact);
+
+	return ComputeSeparationPolygonCircle(b, a, outContact);
+}
+
+// Conservative advancement between two bodies moving from their previous transform to their current one.
+// Returns the fraction of the step at which they first come within `target` pixels of each other, or 1 when they do not
+// touch during the step (or already touched at its start, the contacts take care of that). Both shapes are left at their
+// current transform.
+inline float ComputeTimeOfImpact(RigidBody* a, RigidBody* b, const float target)
+{
+	constexpr int maxIterations = 20;
+
+	const Vec2 aMotion = a->m_position - a->m_previousPosition;
+	const Vec2 bMotion = b->m_position - b->m_previousPosition;
+	const float aTurn = a->m_rotation - a->m_previousRotation;
+	const float bTurn = b->m_rotation - b->m_previousRotation;
+
+	// Upper bound of how much the turning can bring the outlines closer, anywhere on the shapes
+	const float turnBound = std::abs(aTurn) * a->m_radius + std::abs(bTurn) * b->m_radius;
+
+	float t = 0.0f;
+	float timeOfImpact = 1.0f;
+	Contact contact;
+	for (int i = 0; i < maxIterations; i++)
+	{
+		a->m_shape->UpdateVertices(a->m_previousPosition + aMotion * t, a->m_previousRotation + aTurn * t);
+		b->m_shape->UpdateVertices(b->m_previousPosition + bMotion * t, b->m_previousRotation + bTurn * t);
+
+		const float separation = ComputeSeparation(a, b, contact);
+		if (separation <= target)
+		{
+			timeOfImpact = i == 0 ? 1.0f : t;
+			break;
+		}
+
+		// The separation is measured with the shapes at their position at t, so is the motion along the normal
+		const Vec2 relativeMotion = contact.a == a ? bMotion - aMotion : aMotion - bMotion;
+		const float closing = turnBound - relativeMotion.Dot(contact.normal);
+		if (closing <= 0.0f)
+			break;
+
+		// Moving by less than the separation can not make them overlap, aim a bit under the target to finish
+		t += (separation - 0.5f * target) / closing;
+		if (t >= 1.0f)
+			break;
+	}
+
+	a->m_shape->UpdateVertices(a->m_position, a->m_rotation);
+	b->m_shape->UpdateVertices(b->m_position, b->m_rotation);
 
-	return false;
+	return timeOfImpact;
 }
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Which bodies a body collides with, checked between the broad phase and the narrow phase.
+// Two bodies collide when the category of each one is in the mask of the other. Bodies of the same group ignore the
+// bits: a positive group always collides, a negative one never does.
+struct CollisionFilter
+{
+	uint16_t categoryBits = 0x0001;
+	uint16_t maskBits = 0xFFFF;
+	int16_t groupIndex = 0;
+
+	[[nodiscard]] bool ShouldCollide(const CollisionFilter& other) const
+	{
+		if (groupIndex == other.groupIndex && groupIndex != 0)
+			return groupIndex > 0;
+
+		return (maskBits & other.categoryBits) != 0 && (other.maskBits & categoryBits) != 0;
+	}
+};
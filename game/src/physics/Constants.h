@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstddef>
+
 constexpr int FPS = 60;
-constexpr float FIXED_DELTA_TIME =  1.0f / 50;
+constexpr int TICK_RATE = 60; // Physics steps per second
+constexpr float FIXED_DELTA_TIME = 1.0f / TICK_RATE;
+constexpr int MAX_STEPS_PER_FRAME = 5; // Past this, the simulation slows down instead of spiraling
 constexpr int PIXELS_PER_METER = 50;
 constexpr std::size_t MEGABYTE = 1024ULL * 1024U;
 constexpr std::size_t KILOBYTE = 1024ULL;
\ No newline at end of file
@@ -1,7 +1,48 @@
 #include "Constraint.h"
+#include "Constants.h"
 #include "RigidBody.h"
 
 #include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Soft step tuning, distances are in pixels
+	constexpr float CONTACT_HERTZ = 30.0f;
+	constexpr float CONTACT_DAMPING_RATIO = 10.0f;
+	constexpr float JOINT_DAMPING_RATIO = 2.0f;
+	constexpr float MAX_BIAS_VELOCITY = 3.0f * PIXELS_PER_METER; // Fastest speed at which overlapping bodies are pushed apart
+	constexpr float RESTITUTION_THRESHOLD = 1.0f * PIXELS_PER_METER; // Slower impacts do not bounce
+	constexpr float LINEAR_SLOP = 0.01f;
+
+	// Split impulse tuning. The pseudo impulses barely turn the bodies: the correction has no friction, so the slightest
+	// tilt it leaves makes stacked boxes creep sideways
+	constexpr float SPLIT_IMPULSE_BETA = 0.2f;
+	constexpr float SPLIT_IMPULSE_TURN_SCALE = 0.2f;
+
+	// Contacts can not be stiffer than a quarter of the substep rate, joints are twice as stiff
+	float GetContactHertz(const float h)
+	{
+		return std::min(CONTACT_HERTZ, 0.25f / h);
+	}
+}
+
+Softness Softness::Make(const float hertz, const float dampingRatio, const float h)
+{
+	if (hertz == 0.0f)
+		return {};
+
+	const float omega = 2.0f * 3.14159265f * hertz;
+	const float a1 = 2.0f * dampingRatio + h * omega;
+	const float a2 = h * omega * a1;
+	const float a3 = 1.0f / (1.0f + a2);
+
+	Softness softness;
+	softness.biasRate = omega / a1;
+	softness.massScale = a2 * a3;
+	softness.impulseScale = a3;
+	return softness;
+}
 
 MatMN Constraint::GetInvM() const
 {
@@ -33,7 +74,72 @@ VecN Constraint::GetVelocities() const
 	return v;
 }
 
+float Constraint::GetCachedLambda(const int index) const
+{
+	return cachedLambda[index];
+}
+
+void Constraint::SetCachedLambda(const int index, const float lambda)
+{
+	cachedLambda[index] = lambda;
+}
+
+float Constraint::GetRowPseudoVelocity(const int row) const
+{
+	const VecN& j = jacobian.rows[row];
+	return j[0] * a->m_pseudoVelocity.x + j[1] * a->m_pseudoVelocity.y + j[2] * a->m_pseudoAngularVelocity
+		+ j[3] * b->m_pseudoVelocity.x + j[4] * b->m_pseudoVelocity.y + j[5] * b->m_pseudoAngularVelocity;
+}
+
+void Constraint::ApplyRowPseudoImpulse(const int row, const float lambda, const float turnScale) const
+{
+	const VecN& j = jacobian.rows[row];
+	a->ApplyPseudoImpulseLinear(Vec2(j[0], j[1]) * lambda);
+	a->ApplyPseudoImpulseAngular(j[2] * lambda * turnScale);
+	b->ApplyPseudoImpulseLinear(Vec2(j[3], j[4]) * lambda);
+	b->ApplyPseudoImpulseAngular(j[5] * lambda * turnScale);
+}
+
+float Constraint::GetAccumulatedImpulse() const
+{
+	float impulse = 0.0f;
+	for (int i = 0; i < cachedLambda.n; i++)
+		impulse += std::abs(cachedLambda[i]);
+
+	return impulse;
+}
+
+float Constraint::GetRowVelocity(const int row) const
+{
+	const VecN& j = jacobian.rows[row];
+	return j[0] * a->m_velocity.x + j[1] * a->m_velocity.y + j[2] * a->m_angularVelocity
+		+ j[3] * b->m_velocity.x + j[4] * b->m_velocity.y + j[5] * b->m_angularVelocity;
+}
+
+float Constraint::GetRowEffectiveMass(const int row) const
+{
+	// Inverse of J * M^-1 * Jt for a single row
+	const VecN& j = jacobian.rows[row];
+	const float k = (j[0] * j[0] + j[1] * j[1]) * a->m_invMass + j[2] * j[2] * a->m_invInertia
+		+ (j[3] * j[3] + j[4] * j[4]) * b->m_invMass + j[5] * j[5] * b->m_invInertia;
+
+	return k > 0.0f ? 1.0f / k : 0.0f;
+}
+
+void Constraint::ApplyRowImpulse(const int row, const float lambda) const
+{
+	const VecN& j = jacobian.rows[row];
+	a->ApplyImpulseLinear(Vec2(j[0], j[1]) * lambda);
+	a->ApplyImpulseAngular(j[2] * lambda);
+	b->ApplyImpulseLinear(Vec2(j[3], j[4]) * lambda);
+	b->ApplyImpulseAngular(j[5] * lambda);
+}
+
 JointConstraint::JointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& anchorPoint)
+	: JointConstraint(aRb, bRb, aRb->WorldToLocal(anchorPoint), bRb->WorldToLocal(anchorPoint))
+{}
+
+JointConstraint::JointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& aLocalPoint, const Vec2& bLocalPoint)
 {
 	jacobian = MatMN(1, 6);
 	cachedLambda = VecN(1);
@@ -41,13 +147,13 @@ JointConstraint::JointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& anc
 
 	a = aRb;
 	b = bRb;
-	aPoint = a->WorldToLocal(anchorPoint);
-	bPoint = b->WorldToLocal(anchorPoint);
+	aPoint = aLocalPoint;
+	bPoint = bLocalPoint;
 
 	cachedLambda.Zero();
 }
 
-void JointConstraint::PreSolve(const float dt)
+void JointConstraint::UpdateJacobian()
 {
 	// Get the anchor point position in world space
 	const Vec2 pa = a->LocalToWorld(aPoint);
@@ -71,6 +177,14 @@ void JointConstraint::PreSolve(const float dt)
 
 	const float j4 = rb.Cross(pb - pa) * 2.0f;
 	jacobian.rows[0][5] = j4; // B angular velocity
+}
+
+void JointConstraint::PreSolve(const float dt)
+{
+	UpdateJacobian();
+
+	const Vec2 pa = a->LocalToWorld(aPoint);
+	const Vec2 pb = b->LocalToWorld(bPoint);
 
 	// Warm starting (apply cached lambda)
 	VecN impulses = jacobian.Transpose() * cachedLambda;
@@ -90,7 +204,7 @@ void JointConstraint::PreSolve(const float dt)
 	bias = beta / dt * c;
 }
 
-void JointConstraint::Solve()
+float JointConstraint::Solve()
 {
 	const VecN v = GetVelocities();
 	const MatMN invM = GetInvM();
@@ -117,6 +231,8 @@ void JointConstraint::Solve()
 	a->ApplyImpulseAngular(impulses[2]);
 	b->ApplyImpulseLinear(Vec2(impulses[3], impulses[4]));
 	b->ApplyImpulseAngular(impulses[5]);
+
+	return std::abs(lambda[0]);
 }
 
 void JointConstraint::PostSolve()
@@ -125,6 +241,45 @@ void JointConstraint::PostSolve()
 	cachedLambda[0] = std::clamp(cachedLambda[0], -10000.0f, 10000.0f);
 }
 
+void JointConstraint::Prepare(const float h)
+{
+	UpdateJacobian();
+	effectiveMass = GetRowEffectiveMass(0);
+	softness = Softness::Make(2.0f * GetContactHertz(h), JOINT_DAMPING_RATIO, h);
+}
+
+void JointConstraint::WarmStart()
+{
+	ApplyRowImpulse(0, cachedLambda[0]);
+}
+
+float JointConstraint::SolveSoft(const float /*h*/, const bool useBias)
+{
+	if (effectiveMass == 0.0f)
+		return 0.0f;
+
+	// The jacobian is kept from the start of the step, only the positional error follows the bodies
+	float biasVelocity = 0.0f;
+	float massScale = 1.0f;
+	float impulseScale = 0.0f;
+	if (useBias)
+	{
+		const Vec2 pa = a->LocalToWorld(aPoint);
+		const Vec2 pb = b->LocalToWorld(bPoint);
+		const float c = std::max(0.0f, (pb - pa).Dot(pb - pa) - 0.01f);
+
+		biasVelocity = softness.biasRate * c;
+		massScale = softness.massScale;
+		impulseScale = softness.impulseScale;
+	}
+
+	const float lambda = -effectiveMass * massScale * (GetRowVelocity(0) + biasVelocity) - impulseScale * cachedLambda[0];
+	cachedLambda[0] += lambda;
+	ApplyRowImpulse(0, lambda);
+
+	return std::abs(lambda);
+}
+
 PenetrationConstraint::PenetrationConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& aCollisionPoint, const Vec2& bCollisionPoint, const Vec2& collisionNormal)
 {
 	jacobian = MatMN(2, 6);
@@ -152,26 +307,8 @@ void PenetrationConstraint::PreSolve(const float dt)
 	const Vec2 ra = pa - a->m_position;
 	const Vec2 rb = pb - b->m_position;
 
-	jacobian.Zero();
-
-	jacobian.rows[0][0] = -n.x; // A linear velocity.x
-	jacobian.rows[0][1] = -n.y; // A linear velocity.y
-	jacobian.rows[0][2] = -ra.Cross(n); // A angular velocity
-	jacobian.rows[0][3] = n.x; // B linear velocity.x
-	jacobian.rows[0][4] = n.y; // B linear velocity.y
-	jacobian.rows[0][5] = rb.Cross(n); // B angular velocity
-
 	friction = std::max(a->m_friction, b->m_friction);
-	if (friction > 0.0f)
-	{
-		const Vec2 t = n.Perpendicular(); // Tangent vector
-		jacobian.rows[1][0] = -t.x;
-		jacobian.rows[1][1] = -t.y;
-		jacobian.rows[1][2] = -ra.Cross(t);
-		jacobian.rows[1][3] = t.x;
-		jacobian.rows[1][4] = t.y;
-		jacobian.rows[1][5] = rb.Cross(t);
-	}
+	UpdateJacobian(n, ra, rb);
 
 	// Warm starting (apply cached lambda)
 	VecN impulses = jacobian.Transpose() * cachedLambda;
@@ -184,6 +321,13 @@ void PenetrationConstraint::PreSolve(const float dt)
 
 	// Compute the positional error
 	float c = (pb - pa).Dot(-n);
+	if (c > 0.0f)
+	{
+		// Speculative contact: the bodies are still apart, they may only close the gap during this step
+		bias = c / dt;
+		return;
+	}
+
 	c = std::min(0.0f, c + 0.01f);
 
 	//// Calculate relative velocity pre-impulse normal, which will be used to compute elasticity
@@ -199,7 +343,7 @@ void PenetrationConstraint::PreSolve(const float dt)
 	bias = beta / dt * c /*+ e * vRelDotNormal*/;
 }
 
-void PenetrationConstraint::Solve()
+float PenetrationConstraint::Solve()
 {
 	const VecN v = GetVelocities();
 	const MatMN invM = GetInvM();
@@ -219,6 +363,7 @@ void PenetrationConstraint::Solve()
 	const VecN oldLambda = cachedLambda;
 	cachedLambda += lambda;
 	cachedLambda[0] = cachedLambda[0] < 0.0f ? 0.0f : cachedLambda[0];
+	maxNormalImpulse = std::max(maxNormalImpulse, cachedLambda[0]);
 
 	if (friction > 0.0f)
 	{
@@ -236,9 +381,164 @@ void PenetrationConstraint::Solve()
 	a->ApplyImpulseAngular(impulses[2]);
 	b->ApplyImpulseLinear(Vec2(impulses[3], impulses[4]));
 	b->ApplyImpulseAngular(impulses[5]);
+
+	return std::abs(lambda[0]) + std::abs(lambda[1]);
 }
 
 void PenetrationConstraint::PostSolve()
 {
 	Constraint::PostSolve();
 }
+
+void PenetrationConstraint::PrepareSplitImpulse(const float dt)
+{
+	const Vec2 pa = a->LocalToWorld(aPoint);
+	const Vec2 pb = b->LocalToWorld(bPoint);
+	const Vec2 n = a->LocalToWorld(normal);
+	const float c = (pb - pa).Dot(-n);
+	pseudoLambda = 0.0f;
+
+	// A speculative contact keeps its bias, it only limits the velocity and has no position error to correct
+	if (c > 0.0f)
+	{
+		positionBias = 0.0f;
+		positionMass = 0.0f;
+		return;
+	}
+
+	// The Baumgarte term leaves the velocity solve, PreSolve must have run
+	bias = 0.0f;
+	positionBias = SPLIT_IMPULSE_BETA / dt * std::min(0.0f, c + LINEAR_SLOP);
+
+	// Effective mass of the normal row with the turn scale applied to the inverse inertias
+	const VecN& j = jacobian.rows[0];
+	const float k = (j[0] * j[0] + j[1] * j[1]) * a->m_invMass + j[2] * j[2] * a->m_invInertia * SPLIT_IMPULSE_TURN_SCALE
+		+ (j[3] * j[3] + j[4] * j[4]) * b->m_invMass + j[5] * j[5] * b->m_invInertia * SPLIT_IMPULSE_TURN_SCALE;
+	positionMass = k > 0.0f ? 1.0f / k : 0.0f;
+}
+
+float PenetrationConstraint::SolvePosition()
+{
+	// Same as the normal row of Solve, on the pseudo velocities and with the position error as the only target
+	const float lambda = -positionMass * (GetRowPseudoVelocity(0) + positionBias);
+	const float oldLambda = pseudoLambda;
+	pseudoLambda = std::max(oldLambda + lambda, 0.0f);
+	ApplyRowPseudoImpulse(0, pseudoLambda - oldLambda, SPLIT_IMPULSE_TURN_SCALE);
+
+	return std::abs(pseudoLambda - oldLambda);
+}
+
+void PenetrationConstraint::UpdateJacobian(const Vec2& n, const Vec2& ra, const Vec2& rb)
+{
+	jacobian.Zero();
+
+	jacobian.rows[0][0] = -n.x; // A linear velocity.x
+	jacobian.rows[0][1] = -n.y; // A linear velocity.y
+	jacobian.rows[0][2] = -ra.Cross(n); // A angular velocity
+	jacobian.rows[0][3] = n.x; // B linear velocity.x
+	jacobian.rows[0][4] = n.y; // B linear velocity.y
+	jacobian.rows[0][5] = rb.Cross(n); // B angular velocity
+
+	if (friction > 0.0f)
+	{
+		const Vec2 t = n.Perpendicular(); // Tangent vector
+		jacobian.rows[1][0] = -t.x;
+		jacobian.rows[1][1] = -t.y;
+		jacobian.rows[1][2] = -ra.Cross(t);
+		jacobian.rows[1][3] = t.x;
+		jacobian.rows[1][4] = t.y;
+		jacobian.rows[1][5] = rb.Cross(t);
+	}
+}
+
+void PenetrationConstraint::Prepare(const float h)
+{
+	// The collision points: pa lies on B's surface and pb on A's surface
+	const Vec2 pa = a->LocalToWorld(aPoint);
+	const Vec2 pb = b->LocalToWorld(bPoint);
+	const Vec2 n = a->LocalToWorld(normal);
+
+	friction = std::max(a->m_friction, b->m_friction);
+	UpdateJacobian(n, pa - a->m_position, pb - b->m_position);
+
+	// Anchor each surface point on its own body, so the separation can be measured again after every substep
+	worldNormal = n;
+	aSurfacePoint = a->WorldToLocal(pb);
+	bSurfacePoint = b->WorldToLocal(pa);
+
+	normalMass = GetRowEffectiveMass(0);
+	tangentMass = friction > 0.0f ? GetRowEffectiveMass(1) : 0.0f;
+	restitution = std::min(a->m_restitution, b->m_restitution);
+	relativeVelocity = GetRowVelocity(0);
+	softness = Softness::Make(GetContactHertz(h), CONTACT_DAMPING_RATIO, h);
+}
+
+void PenetrationConstraint::WarmStart()
+{
+	ApplyRowImpulse(0, cachedLambda[0]);
+
+	if (friction > 0.0f)
+		ApplyRowImpulse(1, cachedLambda[1]);
+}
+
+float PenetrationConstraint::SolveSoft(const float h, const bool useBias)
+{
+	// Current separation, negative when overlapping
+	const Vec2 pa = a->LocalToWorld(aSurfacePoint);
+	const Vec2 pb = b->LocalToWorld(bSurfacePoint);
+	const float separation = (pb - pa).Dot(worldNormal);
+
+	float biasVelocity = 0.0f;
+	float massScale = 1.0f;
+	float impulseScale = 0.0f;
+	if (separation > 0.0f)
+	{
+		// Not touching yet, only remove the velocity that would make them overlap during this substep
+		biasVelocity = separation / h;
+	}
+	else if (useBias)
+	{
+		biasVelocity = std::max(softness.biasRate * std::min(0.0f, separation + LINEAR_SLOP), -MAX_BIAS_VELOCITY);
+		massScale = softness.massScale;
+		impulseScale = softness.impulseScale;
+	}
+
+	// Normal impulse, the accumulated value can only push
+	float lambda = -normalMass * massScale * (GetRowVelocity(0) + biasVelocity) - impulseScale * cachedLambda[0];
+	const float oldNormal = cachedLambda[0];
+	cachedLambda[0] = std::max(oldNormal + lambda, 0.0f);
+	ApplyRowImpulse(0, cachedLambda[0] - oldNormal);
+	maxNormalImpulse = std::max(maxNormalImpulse, cachedLambda[0]);
+	float applied = std::abs(cachedLambda[0] - oldNormal);
+
+	if (friction > 0.0f)
+	{
+		// Friction impulse, bounded by the normal impulse
+		lambda = -tangentMass * GetRowVelocity(1);
+		const float maxFriction = cachedLambda[0] * friction;
+		const float oldTangent = cachedLambda[1];
+		cachedLambda[1] = std::clamp(oldTangent + lambda, -maxFriction, maxFriction);
+		ApplyRowImpulse(1, cachedLambda[1] - oldTangent);
+		applied += std::abs(cachedLambda[1] - oldTangent);
+	}
+
+	return applied;
+}
+
+void PenetrationConstraint::ApplyRestitution()
+{
+	if (restitution == 0.0f || relativeVelocity > -RESTITUTION_THRESHOLD || cachedLambda[0] == 0.0f)
+		return;
+
+	// Aim for the relative normal velocity before solving, reversed and scaled by the restitution
+	const float lambda = -normalMass * (GetRowVelocity(0) + restitution * relativeVelocity);
+	const float oldNormal = cachedLambda[0];
+	cachedLambda[0] = std::max(oldNormal + lambda, 0.0f);
+	ApplyRowImpulse(0, cachedLambda[0] - oldNormal);
+	maxNormalImpulse = std::max(maxNormalImpulse, cachedLambda[0]);
+}
+
+float PenetrationConstraint::GetMaxNormalImpulse() const
+{
+	return maxNormalImpulse;
+}
@@ -6,6 +6,16 @@
 
 class RigidBody;
 
+// Coefficients of a soft constraint, behaving like a damped spring of the given frequency (hertz) and damping ratio for a time step h
+struct Softness
+{
+	float biasRate = 0.0f;
+	float massScale = 1.0f;
+	float impulseScale = 0.0f;
+
+	static Softness Make(float hertz, float dampingRatio, float h);
+};
+
 struct Constraint
 {
 	RigidBody* a;
@@ -24,11 +34,31 @@ struct Constraint
 	[[nodiscard]] MatMN GetInvM() const;
 	[[nodiscard]] VecN GetVelocities() const;
 
-	virtual void PreSolve(float dt) {}
-	virtual void Solve() {}
+	// Warm starting cache, exposed so the world state can be saved and restored
+	[[nodiscard]] float GetCachedLambda(int index) const;
+	void SetCachedLambda(int index, float lambda);
+
+	// Sum of the accumulated impulses of all the rows, used to measure the convergence of the solver
+	[[nodiscard]] float GetAccumulatedImpulse() const;
+
+	// Solve returns the sum of the impulses applied by this iteration
+	virtual void PreSolve(float /*dt*/) {}
+	virtual float Solve() { return 0.0f; }
 	virtual void PostSolve() {}
 
+	// Soft step solver: the constraint is prepared once per step, then warm started and solved once per substep of length h
+	virtual void Prepare(float /*h*/) {}
+	virtual void WarmStart() {}
+	virtual float SolveSoft(float /*h*/, bool /*useBias*/) { return 0.0f; }
+
 protected:
+	// Scalar helpers on one row of the jacobian, they avoid building the full matrices when solving one row at a time
+	[[nodiscard]] float GetRowVelocity(int row) const;
+	[[nodiscard]] float GetRowEffectiveMass(int row) const;
+	void ApplyRowImpulse(int row, float lambda) const;
+	[[nodiscard]] float GetRowPseudoVelocity(int row) const;
+	void ApplyRowPseudoImpulse(int row, float lambda, float turnScale = 1.0f) const;
+
 	float bias;
 	VecN cachedLambda;
 	MatMN jacobian;
@@ -38,9 +68,24 @@ struct JointConstraint final : Constraint
 {
 public:
 	JointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& anchorPoint);
+	JointConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& aLocalPoint, const Vec2& bLocalPoint);
+
+	// Whether the joined bodies still collide with each other, read when the joint is added to the world
+	bool collideConnected = false;
+
 	void PreSolve(float dt) override;
-	void Solve() override;
+	float Solve() override;
 	void PostSolve() override;
+
+	void Prepare(float h) override;
+	void WarmStart() override;
+	float SolveSoft(float h, bool useBias) override;
+
+private:
+	void UpdateJacobian();
+
+	float effectiveMass = 0.0f;
+	Softness softness;
 };
 
 struct PenetrationConstraint final : Constraint
@@ -49,9 +94,40 @@ private:
 	float friction;
 	Vec2 normal;
 
+	// Soft step data, computed in Prepare
+	Vec2 worldNormal;
+	Vec2 aSurfacePoint; // Deepest point of A's surface, in A's local space
+	Vec2 bSurfacePoint; // Deepest point of B's surface, in B's local space
+	float normalMass = 0.0f;
+	float tangentMass = 0.0f;
+	float restitution = 0.0f;
+	float relativeVelocity = 0.0f; // Normal velocity before solving, for restitution
+	Softness softness;
+
+	// Split impulse data, computed in PrepareSplitImpulse
+	float positionBias = 0.0f;
+	float positionMass = 0.0f;
+	float pseudoLambda = 0.0f;
+
+	float maxNormalImpulse = 0.0f; // Largest accumulated normal impulse of the step, for the contact events
+
 public:
 	PenetrationConstraint(RigidBody* aRb, RigidBody* bRb, const Vec2& aCollisionPoint, const Vec2& bCollisionPoint, const Vec2& collisionNormal);
 	void PreSolve(float dt) override;
-	void Solve() override;
+	float Solve() override;
 	void PostSolve() override;
+
+	void Prepare(float h) override;
+	void WarmStart() override;
+	float SolveSoft(float h, bool useBias) override;
+	void ApplyRestitution();
+
+	// Split impulse: the position error is removed by pseudo velocities instead of biasing the velocity solve
+	void PrepareSplitImpulse(float dt);
+	float SolvePosition();
+
+	[[nodiscard]] float GetMaxNormalImpulse() const;
+
+private:
+	void UpdateJacobian(const Vec2& n, const Vec2& ra, const Vec2& rb);
 };
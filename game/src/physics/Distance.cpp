@@ -0,0 +1,333 @@
+#include "Distance.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	constexpr int MAX_GJK_ITERATIONS = 20;
+	constexpr int MAX_EPA_VERTICES = 32;
+	constexpr float EPA_TOLERANCE = 0.01f; // Pixels
+	constexpr float DEGENERATE_DISTANCE = 1e-4f; // Pixels
+
+	// Point of the Minkowski difference b - a, with the points of a and b it comes from
+	struct SimplexVertex
+	{
+		Vec2 wA;
+		Vec2 wB;
+		Vec2 w;
+		float weight; // Barycentric coordinate of the closest point to the origin
+		int indexA;
+		int indexB;
+	};
+
+	SimplexVertex MakeVertex(const ConvexProxy& a, const ConvexProxy& b, const Vec2& direction)
+	{
+		SimplexVertex vertex;
+		vertex.indexA = a.Support(-direction);
+		vertex.indexB = b.Support(direction);
+		vertex.wA = a.vertices[vertex.indexA];
+		vertex.wB = b.vertices[vertex.indexB];
+		vertex.w = vertex.wB - vertex.wA;
+		vertex.weight = 1.0f;
+		return vertex;
+	}
+
+	// Perpendicular of a vector, on the side of the given sign
+	Vec2 Perpendicular(const Vec2& v, const float side)
+	{
+		return side > 0.0f ? Vec2(-v.y, v.x) : Vec2(v.y, -v.x);
+	}
+
+	struct Simplex
+	{
+		SimplexVertex v[3];
+		int count;
+
+		[[nodiscard]] Vec2 SearchDirection() const
+		{
+			if (count == 1)
+				return -v[0].w;
+
+			// Towards the origin, on its side of the edge
+			const Vec2 edge = v[1].w - v[0].w;
+			return Perpendicular(edge, edge.Cross(-v[0].w));
+		}
+
+		void WitnessPoints(Vec2& pointA, Vec2& pointB) const
+		{
+			pointA = Vec2::Zero();
+			pointB = Vec2::Zero();
+			for (int i = 0; i < count; i++)
+			{
+				pointA += v[i].wA * v[i].weight;
+				pointB += v[i].wB * v[i].weight;
+			}
+		}
+
+		// Closest point of a segment to the origin, keeps the vertex alone when it is one of the ends
+		void Solve2()
+		{
+			const Vec2 e12 = v[1].w - v[0].w;
+
+			const float d12_2 = -v[0].w.Dot(e12);
+			if (d12_2 <= 0.0f)
+			{
+				v[0].weight = 1.0f;
+				count = 1;
+				return;
+			}
+
+			const float d12_1 = v[1].w.Dot(e12);
+			if (d12_1 <= 0.0f)
+			{
+				v[1].weight = 1.0f;
+				v[0] = v[1];
+				count = 1;
+				return;
+			}
+
+			const float inv = 1.0f / (d12_1 + d12_2);
+			v[0].weight = d12_1 * inv;
+			v[1].weight = d12_2 * inv;
+			count = 2;
+		}
+
+		// Closest point of a triangle to the origin, keeping the smallest feature (vertex, edge or the whole triangle)
+		void Solve3()
+		{
+			const Vec2 w1 = v[0].w;
+			const Vec2 w2 = v[1].w;
+			const Vec2 w3 = v[2].w;
+
+			const Vec2 e12 = w2 - w1;
+			const float d12_1 = w2.Dot(e12);
+			const float d12_2 = -w1.Dot(e12);
+
+			const Vec2 e13 = w3 - w1;
+			const float d13_1 = w3.Dot(e13);
+			const float d13_2 = -w1.Dot(e13);
+
+			const Vec2 e23 = w3 - w2;
+			const float d23_1 = w3.Dot(e23);
+			const float d23_2 = -w2.Dot(e23);
+
+			const float n123 = e12.Cross(e13);
+			const float d123_1 = n123 * w2.Cross(w3);
+			const float d123_2 = n123 * w3.Cross(w1);
+			const float d123_3 = n123 * w1.Cross(w2);
+
+			if (d12_2 <= 0.0f && d13_2 <= 0.0f)
+			{
+				v[0].weight = 1.0f;
+				count = 1;
+				return;
+			}
+
+			if (d12_1 > 0.0f && d12_2 > 0.0f && d123_3 <= 0.0f)
+			{
+				const float inv = 1.0f / (d12_1 + d12_2);
+				v[0].weight = d12_1 * inv;
+				v[1].weight = d12_2 * inv;
+				count = 2;
+				return;
+			}
+
+			if (d13_1 > 0.0f && d13_2 > 0.0f && d123_2 <= 0.0f)
+			{
+				const float inv = 1.0f / (d13_1 + d13_2);
+				v[0].weight = d13_1 * inv;
+				v[2].weight = d13_2 * inv;
+				v[1] = v[2];
+				count = 2;
+				return;
+			}
+
+			if (d12_1 <= 0.0f && d23_2 <= 0.0f)
+			{
+				v[1].weight = 1.0f;
+				v[0] = v[1];
+				count = 1;
+				return;
+			}
+
+			if (d13_1 <= 0.0f && d23_1 <= 0.0f)
+			{
+				v[2].weight = 1.0f;
+				v[0] = v[2];
+				count = 1;
+				return;
+			}
+
+			if (d23_1 > 0.0f && d23_2 > 0.0f && d123_1 <= 0.0f)
+			{
+				const float inv = 1.0f / (d23_1 + d23_2);
+				v[1].weight = d23_1 * inv;
+				v[2].weight = d23_2 * inv;
+				v[0] = v[2];
+				count = 2;
+				return;
+			}
+
+			// The origin is inside the triangle
+			const float inv = 1.0f / (d123_1 + d123_2 + d123_3);
+			v[0].weight = d123_1 * inv;
+			v[1].weight = d123_2 * inv;
+			v[2].weight = d123_3 * inv;
+			count = 3;
+		}
+	};
+
+	// Runs GJK until the simplex holds the closest point of b - a to the origin, or the origin itself. Returns whether
+	// the cores overlap (or touch).
+	bool RunGjk(const ConvexProxy& a, const ConvexProxy& b, Simplex& simplex)
+	{
+		simplex.v[0] = MakeVertex(a, b, b.vertices[0] - a.vertices[0]);
+		simplex.count = 1;
+
+		for (int iteration = 0; iteration < MAX_GJK_ITERATIONS; iteration++)
+		{
+			int savedA[3];
+			int savedB[3];
+			const int savedCount = simplex.count;
+			for (int i = 0; i < savedCount; i++)
+			{
+				savedA[i] = simplex.v[i].indexA;
+				savedB[i] = simplex.v[i].indexB;
+			}
+
+			if (simplex.count == 2)
+				simplex.Solve2();
+			else if (simplex.count == 3)
+				simplex.Solve3();
+
+			if (simplex.count == 3)
+				return true;
+
+			const Vec2 direction = simplex.SearchDirection();
+			if (direction.MagnitudeSquared() < DEGENERATE_DISTANCE * DEGENERATE_DISTANCE)
+				return true;
+
+			// Stop once the support point is already in the simplex, there is no progress left to make
+			const SimplexVertex vertex = MakeVertex(a, b, direction);
+			bool isDuplicate = false;
+			for (int i = 0; i < savedCount; i++)
+				isDuplicate |= vertex.indexA == savedA[i] && vertex.indexB == savedB[i];
+
+			if (isDuplicate)
+				break;
+
+			simplex.v[simplex.count++] = vertex;
+		}
+
+		Vec2 pointA, pointB;
+		simplex.WitnessPoints(pointA, pointB);
+		return (pointB - pointA).MagnitudeSquared() < DEGENERATE_DISTANCE * DEGENERATE_DISTANCE;
+	}
+}
+
+DistanceOutput ComputeDistance(const ConvexProxy& a, const ConvexProxy& b)
+{
+	Simplex simplex;
+	DistanceOutput output;
+	output.isOverlapping = RunGjk(a, b, simplex);
+
+	simplex.WitnessPoints(output.pointA, output.pointB);
+	output.distance = output.isOverlapping ? 0.0f : (output.pointB - output.pointA).Magnitude();
+	return output;
+}
+
+bool ComputePenetration(const ConvexProxy& a, const ConvexProxy& b, PenetrationOutput& output)
+{
+	Simplex simplex;
+	if (RunGjk(a, b, simplex) == false)
+		return false;
+
+	SimplexVertex polytope[MAX_EPA_VERTICES];
+	int count = simplex.count;
+	for (int i = 0; i < count; i++)
+		polytope[i] = simplex.v[i];
+
+	// GJK stops early when the origin is on a vertex or an edge, grow the simplex to a triangle
+	if (count == 1)
+	{
+		polytope[count] = MakeVertex(a, b, Vec2(1.0f, 0.0f));
+		if ((polytope[count].w - polytope[0].w).MagnitudeSquared() < DEGENERATE_DISTANCE * DEGENERATE_DISTANCE)
+			polytope[count] = MakeVertex(a, b, Vec2(-1.0f, 0.0f));
+
+		count++;
+	}
+
+	if (count == 2)
+	{
+		const Vec2 edge = polytope[1].w - polytope[0].w;
+		polytope[count] = MakeVertex(a, b, Perpendicular(edge, 1.0f));
+		if (std::abs(edge.Cross(polytope[count].w - polytope[0].w)) < DEGENERATE_DISTANCE)
+			polytope[count] = MakeVertex(a, b, Perpendicular(edge, -1.0f));
+
+		// Flat difference, the cores only touch
+		if (std::abs(edge.Cross(polytope[count].w - polytope[0].w)) < DEGENERATE_DISTANCE)
+		{
+			output.normal = Perpendicular(edge, 1.0f).Normalize();
+			output.depth = 0.0f;
+			output.pointA = polytope[0].wA;
+			output.pointB = polytope[0].wB;
+			return true;
+		}
+
+		count++;
+	}
+
+	// Wind the polytope counter clockwise so the outward normal of an edge is on its right
+	if ((polytope[1].w - polytope[0].w).Cross(polytope[2].w - polytope[0].w) < 0.0f)
+		std::swap(polytope[1], polytope[2]);
+
+	int closestEdge = 0;
+	Vec2 closestNormal;
+	float closestDistance = 0.0f;
+	for (;;)
+	{
+		// Find the edge of the polytope closest to the origin
+		closestDistance = std::numeric_limits<float>::max();
+		for (int i = 0; i < count; i++)
+		{
+			const Vec2 edge = polytope[(i + 1) % count].w - polytope[i].w;
+			const float length = edge.Magnitude();
+			if (length < DEGENERATE_DISTANCE)
+				continue;
+
+			const Vec2 normal = Vec2(edge.y, -edge.x) / length;
+			const float distance = normal.Dot(polytope[i].w);
+			if (distance < closestDistance)
+			{
+				closestDistance = distance;
+				closestNormal = normal;
+				closestEdge = i;
+			}
+		}
+
+		// Push that edge out until it is on the boundary of the difference
+		const SimplexVertex vertex = MakeVertex(a, b, closestNormal);
+		if (vertex.w.Dot(closestNormal) - closestDistance < EPA_TOLERANCE || count == MAX_EPA_VERTICES)
+			break;
+
+		for (int i = count; i > closestEdge + 1; i--)
+			polytope[i] = polytope[i - 1];
+
+		polytope[closestEdge + 1] = vertex;
+		count++;
+	}
+
+	// The origin projected on the closest edge gives the deepest points
+	const SimplexVertex& v0 = polytope[closestEdge];
+	const SimplexVertex& v1 = polytope[(closestEdge + 1) % count];
+	const Vec2 edge = v1.w - v0.w;
+	const float t = std::clamp(-v0.w.Dot(edge) / edge.MagnitudeSquared(), 0.0f, 1.0f);
+
+	output.pointA = v0.wA + (v1.wA - v0.wA) * t;
+	output.pointB = v0.wB + (v1.wB - v0.wB) * t;
+	output.normal = -closestNormal; // b moves out of a against the normal of the difference b - a
+	output.depth = closestDistance;
+	return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Shape.h"
+#include "Vec2.h"
+
+// Closest points of the cores of two convex proxies (their vertices, without the radius)
+struct DistanceOutput
+{
+	Vec2 pointA;
+	Vec2 pointB;
+	float distance;
+	bool isOverlapping; // The cores overlap, the points and distance are meaningless
+};
+
+// Penetration of the cores of two convex proxies, when they overlap
+struct PenetrationOutput
+{
+	Vec2 pointA; // Deepest point of the core of a inside b
+	Vec2 pointB; // Deepest point of the core of b inside a
+	Vec2 normal; // From a to b
+	float depth;
+};
+
+// GJK distance between the cores of two convex proxies
+DistanceOutput ComputeDistance(const ConvexProxy& a, const ConvexProxy& b);
+
+// EPA penetration of the cores of two convex proxies, false when they do not overlap
+bool ComputePenetration(const ConvexProxy& a, const ConvexProxy& b, PenetrationOutput& output);
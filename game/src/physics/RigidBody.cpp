@@ -1,24 +1,43 @@
 #include "physics/RigidBody.h"
 #include "physics/Shape.h"
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 RigidBody::RigidBody(const Shape& shape, const int x, const int y, const float mass)
+	: RigidBody(shape.Clone(), Vec2(static_cast<float>(x), static_cast<float>(y)), 0.0f, mass)
+{}
+
+RigidBody::RigidBody(std::unique_ptr<Shape> shape, const Vec2& position, const float rotation, const float mass)
 {
-	m_shape = shape.Clone();
-	m_position = Vec2(static_cast<float>(x), static_cast<float>(y));
+	m_shape = std::move(shape);
+	m_position = position;
 
 	m_velocity = Vec2::Zero();
 	m_acceleration = Vec2::Zero();
 
-	m_rotation = 0.0f;
+	m_rotation = rotation;
+	m_previousPosition = m_position;
+	m_previousRotation = m_rotation;
+	m_stepTicks = 1;
+	m_ticksSinceStep = 0;
 	m_angularAcceleration = 0.0f;
 	m_angularVelocity = 0.0f;
 
+	m_pseudoVelocity = Vec2::Zero();
+	m_pseudoAngularVelocity = 0.0f;
+
+	m_isBullet = false;
+	m_isSensor = false;
+
+	m_lodTier = 0;
+	m_lodIndex = 0;
+
 	m_sumForces = Vec2::Zero();
 	m_sumTorque = 0.0f;
 
-	m_restitution = 1.0f;
+	m_restitution = 0.2f;
 	m_friction = 0.7f;
 
 	m_mass = mass;
@@ -57,6 +76,27 @@ void RigidBody::ClearTorque()
 	m_sumTorque = 0.0f;
 }
 
+Vec2 RigidBody::InterpolatedPosition(const float alpha) const
+{
+	return m_previousPosition + (m_position - m_previousPosition) * StepFraction(alpha);
+}
+
+float RigidBody::InterpolatedRotation(const float alpha) const
+{
+	return m_previousRotation + (m_rotation - m_previousRotation) * StepFraction(alpha);
+}
+
+float RigidBody::StepFraction(const float alpha) const
+{
+	return std::min(1.0f, (static_cast<float>(m_ticksSinceStep) + alpha) / static_cast<float>(m_stepTicks));
+}
+
+void RigidBody::SavePreviousTransform()
+{
+	m_previousPosition = m_position;
+	m_previousRotation = m_rotation;
+}
+
 Vec2 RigidBody::LocalToWorld(const Vec2& point) const
 {
 	const Vec2 rotated = point.Rotate(m_rotation);
@@ -94,37 +134,54 @@ void RigidBody::ApplyImpulseAngular(const float j)
 	m_angularVelocity += j * m_invInertia;
 }
 
-void RigidBody::ApplyImpulseAtPoint(const Vec2& j, const Vec2& r)
+void RigidBody::ApplyPseudoImpulseLinear(const Vec2& j)
 {
 	if (IsStatic())
 		return;
 
-	m_velocity += j * m_invMass;
-	m_angularVelocity += r.Cross(j) * m_invInertia;
+	m_pseudoVelocity += j * m_invMass;
 }
 
-void RigidBody::IntegrateForces(const float dt)
+void RigidBody::ApplyPseudoImpulseAngular(const float j)
 {
 	if (IsStatic())
 		return;
 
+	m_pseudoAngularVelocity += j * m_invInertia;
+}
+
+void RigidBody::ApplyImpulseAtPoint(const Vec2& j, const Vec2& r)
+{
+	if (IsStatic())
+		return;
+
+	m_velocity += j * m_invMass;
+	m_angularVelocity += r.Cross(j) * m_invInertia;
+}
+
+void RigidBody::IntegrateForces(const float dt, const bool clearForces)
+{
 	m_acceleration = m_sumForces * m_invMass;
 	m_velocity += m_acceleration * dt;
 
 	m_angularAcceleration = m_sumTorque * m_invInertia;
 	m_angularVelocity += m_angularAcceleration * dt;
 
-	ClearForces();
-	ClearTorque();
+	// Substeps integrate the same forces several times and only clear them on the last one
+	if (clearForces)
+	{
+		ClearForces();
+		ClearTorque();
+	}
 }
 
 void RigidBody::IntegrateVelocities(const float dt)
 {
-	if (IsStatic())
-		return;
-
-	m_position += (m_velocity * dt);
-	m_rotation += m_angularVelocity * dt;
+	// The pseudo velocity is only used for this step's motion, it never becomes real velocity
+	m_position += (m_velocity + m_pseudoVelocity) * dt;
+	m_rotation += (m_angularVelocity + m_pseudoAngularVelocity) * dt;
+	m_pseudoVelocity = Vec2::Zero();
+	m_pseudoAngularVelocity = 0.0f;
 
 	m_shape->UpdateVertices(m_position, m_rotation);
 }
@@ -141,6 +198,11 @@ void RigidBody::UpdateBoundingRadius()
 		const auto* circleShape = dynamic_cast<CircleShape*>(m_shape.get());
 		m_radius = circleShape->m_radius;
 	}
+	else if (m_shape->GetType() == CAPSULE || m_shape->GetType() == SEGMENT)
+	{
+		const auto* capsuleShape = dynamic_cast<CapsuleShape*>(m_shape.get());
+		m_radius = capsuleShape->m_halfLength + capsuleShape->m_radius;
+	}
 	else if (m_shape->GetType() == POLYGON || m_shape->GetType() == BOX)
 	{
 		const auto* polygonShape = dynamic_cast<PolygonShape*>(m_shape.get());
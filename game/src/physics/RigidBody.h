@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
 
+#include "CollisionFilter.h"
 #include "Shape.h"
 #include "Vec2.h"
 
@@ -31,14 +33,41 @@ public:
 	float m_angularAcceleration;
 	float m_sumTorque;
 
+	// Split impulse position correction, moves the body once at the end of the step without changing its velocity
+	Vec2 m_pseudoVelocity;
+	float m_pseudoAngularVelocity;
+
+	// Transform at the start of the last step, used to interpolate rendering between fixed steps
+	Vec2 m_previousPosition;
+	float m_previousRotation;
+	// Ticks the last step covered and ticks since then: a body of a level of detail tier that steps less often is drawn
+	// over the whole period of its tier, a few ticks late, instead of waiting and jumping
+	int m_stepTicks;
+	int m_ticksSinceStep;
+
 	// Broadphase
 	float m_radius; // Circle radius for the broadphase check
 
+	// Continuous collision: speculative contacts and time of impact against the other bodies, so it can not tunnel
+	bool m_isBullet;
+
+	// Sensor: only reports the bodies overlapping it, it gets no contact and never pushes anything
+	bool m_isSensor;
+
+	// Collision filtering, the bodies this one collides with
+	CollisionFilter m_filter;
+
+	// Simulation level of detail, set by the world on every step with focus points: the tier the body stepped with (0 on
+	// every tick, 1 on every other tick, 2 on every 4th tick) and its index among the dynamic bodies for the islands
+	int m_lodTier;
+	std::size_t m_lodIndex;
+
 	// Dynamic allocations
 	std::unique_ptr<Shape> m_shape;
 	std::string m_textureId;
 
 	RigidBody(const Shape& shape, int x, int y, float mass = 0.0f);
+	RigidBody(std::unique_ptr<Shape> shape, const Vec2& position, float rotation, float mass);
 
 	[[nodiscard]] bool IsStatic() const;
 
@@ -47,14 +76,22 @@ public:
 	void ClearForces();
 	void ClearTorque();
 
+	[[nodiscard]] Vec2 InterpolatedPosition(float alpha) const;
+	[[nodiscard]] float InterpolatedRotation(float alpha) const;
+	void SavePreviousTransform();
+	// How far the frame between the last two ticks is through the last step of the body
+	[[nodiscard]] float StepFraction(float alpha) const;
+
 	[[nodiscard]] Vec2 LocalToWorld(const Vec2& point) const;
 	[[nodiscard]] Vec2 WorldToLocal(const Vec2& point) const;
 
 	void ApplyImpulseLinear(const Vec2& j);
 	void ApplyImpulseAngular(float j);
 	void ApplyImpulseAtPoint(const Vec2& j, const Vec2& r);
+	void ApplyPseudoImpulseLinear(const Vec2& j);
+	void ApplyPseudoImpulseAngular(float j);
 
-	void IntegrateForces(float dt);
+	void IntegrateForces(float dt, bool clearForces = true);
 	void IntegrateVelocities(float dt);
 
 	void SetTexture(const std::string& textureId);
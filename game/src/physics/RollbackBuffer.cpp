@@ -0,0 +1,242 @@
+#include "physics/RollbackBuffer.h"
+#include "physics/Constraint.h"
+#include "physics/RigidBody.h"
+#include "physics/World.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	constexpr std::size_t WORDS_PER_BODY = 6;
+	constexpr std::size_t WORDS_PER_JOINT = 1;
+	constexpr uint32_t MAX_RUN = 0xFFFF;
+
+	uint32_t ToWord(const float value)
+	{
+		uint32_t word;
+		memcpy(&word, &value, sizeof(word));
+		return word;
+	}
+
+	float ToFloat(const uint32_t word)
+	{
+		float value;
+		memcpy(&value, &word, sizeof(value));
+		return value;
+	}
+}
+
+RollbackBuffer::RollbackBuffer(const std::size_t capacity, const bool deltaCompression)
+	: m_frames(capacity > 0 ? capacity : 1), m_deltaCompression(deltaCompression)
+{}
+
+void RollbackBuffer::Save(const World& world, const uint32_t tick)
+{
+	const auto& bodies = world.GetBodies();
+	const auto& joints = world.GetConstraints();
+
+	// Gather the state in a flat array of words
+	m_scratch.resize(bodies.size() * WORDS_PER_BODY + joints.size() * WORDS_PER_JOINT);
+	uint32_t* out = m_scratch.data();
+
+	for (const auto body : bodies)
+	{
+		*out++ = ToWord(body->m_position.x);
+		*out++ = ToWord(body->m_position.y);
+		*out++ = ToWord(body->m_velocity.x);
+		*out++ = ToWord(body->m_velocity.y);
+		*out++ = ToWord(body->m_rotation);
+		*out++ = ToWord(body->m_angularVelocity);
+	}
+
+	for (const auto joint : joints)
+		*out++ = ToWord(joint->GetCachedLambda(0));
+
+	// The current newest frame becomes a delta against the one we are adding
+	if (m_deltaCompression && m_count > 0)
+	{
+		Frame& previous = m_frames[m_newest];
+		if (previous.isDelta == false && previous.words.size() == m_scratch.size())
+		{
+			EncodeDelta(previous.words, m_scratch, m_delta);
+			previous.words.swap(m_delta);
+			previous.isDelta = true;
+		}
+	}
+
+	m_newest = (m_newest + 1) % m_frames.size();
+	m_count = std::min(m_count + 1, m_frames.size());
+
+	Frame& frame = m_frames[m_newest];
+	frame.tick = tick;
+	frame.bodyCount = static_cast<uint32_t>(bodies.size());
+	frame.jointCount = static_cast<uint32_t>(joints.size());
+	frame.isDelta = false;
+	frame.lodTick = world.GetLodTick();
+	frame.words.assign(m_scratch.begin(), m_scratch.end());
+	world.GetSatCache(frame.satCache);
+	world.GetContactImpulses(frame.contactImpulses);
+	frame.touching.assign(world.GetTouching().begin(), world.GetTouching().end());
+	frame.sensorOverlaps.assign(world.GetSensorOverlaps().begin(), world.GetSensorOverlaps().end());
+}
+
+bool RollbackBuffer::Restore(World& world, const uint32_t tick)
+{
+	auto& bodies = world.GetBodies();
+	auto& joints = world.GetConstraints();
+
+	// Walk back from the newest frame, undoing the deltas on the way
+	std::size_t age = 0;
+	for (; age < m_count; age++)
+	{
+		if (m_frames[SlotAt(age)].tick == tick)
+			break;
+	}
+
+	if (age == m_count)
+		return false;
+
+	m_scratch.assign(m_frames[m_newest].words.begin(), m_frames[m_newest].words.end());
+	for (std::size_t i = 1; i <= age; i++)
+	{
+		const Frame& frame = m_frames[SlotAt(i)];
+		if (frame.isDelta == false)
+			m_scratch.assign(frame.words.begin(), frame.words.end());
+		else
+			ApplyDelta(frame.words, m_scratch);
+	}
+
+	Frame& frame = m_frames[SlotAt(age)];
+	if (frame.bodyCount != bodies.size() || frame.jointCount != joints.size())
+		return false;
+
+	const uint32_t* in = m_scratch.data();
+	for (const auto body : bodies)
+	{
+		const Vec2 position(ToFloat(in[0]), ToFloat(in[1]));
+		const float rotation = ToFloat(in[4]);
+		body->m_velocity = Vec2(ToFloat(in[2]), ToFloat(in[3]));
+		body->m_angularVelocity = ToFloat(in[5]);
+
+		// Compare the words as they are, Vec2 equality has a tolerance and would keep small moves
+		const bool moved = in[0] != ToWord(body->m_position.x) || in[1] != ToWord(body->m_position.y) || in[4] != ToWord(body->m_rotation);
+		in += WORDS_PER_BODY;
+
+		// Rebuild the world vertices and bounding radius only for the bodies that moved since this frame
+		if (moved)
+		{
+			body->m_position = position;
+			body->m_rotation = rotation;
+			body->m_shape->UpdateVertices(body->m_position, body->m_rotation);
+			body->UpdateBoundingRadius();
+		}
+
+		// Do not interpolate rendering across a restore
+		body->SavePreviousTransform();
+	}
+
+	for (const auto joint : joints)
+		joint->SetCachedLambda(0, ToFloat(*in++));
+
+	world.SetSatCache(frame.satCache);
+	world.SetContactImpulses(frame.contactImpulses);
+	world.SetTouching(frame.touching);
+	world.SetSensorOverlaps(frame.sensorOverlaps);
+	world.SetLodTick(frame.lodTick);
+
+	// The restored frame is now the newest one and is stored raw again
+	frame.words.swap(m_scratch);
+	frame.isDelta = false;
+	m_newest = SlotAt(age);
+	m_count -= age;
+
+	return true;
+}
+
+bool RollbackBuffer::Contains(const uint32_t tick) const
+{
+	for (std::size_t age = 0; age < m_count; age++)
+	{
+		if (m_frames[SlotAt(age)].tick == tick)
+			return true;
+	}
+
+	return false;
+}
+
+std::size_t RollbackBuffer::Count() const
+{
+	return m_count;
+}
+
+std::size_t RollbackBuffer::MemoryUsed() const
+{
+	std::size_t bytes = 0;
+	for (std::size_t age = 0; age < m_count; age++)
+	{
+		const Frame& frame = m_frames[SlotAt(age)];
+		bytes += frame.words.size() * sizeof(uint32_t) + frame.satCache.size() * sizeof(SatCacheRecord);
+		bytes += frame.contactImpulses.size() * sizeof(ContactImpulseRecord);
+		bytes += frame.touching.size() * sizeof(ContactEvent) + frame.sensorOverlaps.size() * sizeof(SensorEvent);
+	}
+
+	return bytes;
+}
+
+void RollbackBuffer::Clear()
+{
+	m_count = 0;
+	m_newest = 0;
+}
+
+std::size_t RollbackBuffer::SlotAt(const std::size_t age) const
+{
+	return (m_newest + m_frames.size() - age) % m_frames.size();
+}
+
+void RollbackBuffer::EncodeDelta(const std::vector<uint32_t>& older, const std::vector<uint32_t>& newer, std::vector<uint32_t>& out)
+{
+	// Each run is a header word (zero words to skip << 16 | literal words that follow) and the literal XOR words
+	out.clear();
+
+	const std::size_t n = older.size();
+	std::size_t i = 0;
+	while (i < n)
+	{
+		uint32_t zeros = 0;
+		while (i < n && older[i] == newer[i] && zeros < MAX_RUN)
+		{
+			zeros++;
+			i++;
+		}
+
+		const std::size_t headerIndex = out.size();
+		out.push_back(0);
+
+		uint32_t literals = 0;
+		while (i < n && older[i] != newer[i] && literals < MAX_RUN)
+		{
+			out.push_back(older[i] ^ newer[i]);
+			literals++;
+			i++;
+		}
+
+		out[headerIndex] = (zeros << 16) | literals;
+	}
+}
+
+void RollbackBuffer::ApplyDelta(const std::vector<uint32_t>& delta, std::vector<uint32_t>& words)
+{
+	std::size_t position = 0;
+	std::size_t i = 0;
+	while (i < delta.size())
+	{
+		const uint32_t header = delta[i++];
+		position += header >> 16;
+
+		const uint32_t literals = header & MAX_RUN;
+		for (uint32_t j = 0; j < literals; j++)
+			words[position++] ^= delta[i++];
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "World.h"
+
+// Ring buffer of world states for rollback.
+// A frame holds the dynamic state of every body (position, velocity, rotation, angular velocity), the joints warm starting lambda,
+// the level of detail tick, and the SAT cache, contact impulses, touching pairs and sensor overlaps, which are kept aside as
+// they change size from one tick to the next.
+// With delta compression, only the newest frame is kept raw. Older frames are stored as the XOR with the frame after them,
+// with runs of zero words collapsed, so restoring a recent tick only undoes a few deltas and evicting the oldest frame never breaks the chain.
+class RollbackBuffer
+{
+public:
+	explicit RollbackBuffer(std::size_t capacity, bool deltaCompression = true);
+
+	void Save(const World& world, uint32_t tick);
+
+	// Restores the world to the given tick and drops every newer frame, as they are about to be simulated again.
+	// Fails if the tick is not in the buffer or the world does not have the same bodies and joints anymore.
+	bool Restore(World& world, uint32_t tick);
+
+	[[nodiscard]] bool Contains(uint32_t tick) const;
+	[[nodiscard]] std::size_t Count() const;
+	[[nodiscard]] std::size_t MemoryUsed() const;
+	void Clear();
+
+private:
+	struct Frame
+	{
+		uint32_t tick = 0;
+		uint32_t bodyCount = 0;
+		uint32_t jointCount = 0;
+		bool isDelta = false;
+		uint64_t lodTick = 0; // The level of detail tiers step on it
+		std::vector<uint32_t> words;
+		std::vector<SatCacheRecord> satCache;
+		std::vector<ContactImpulseRecord> contactImpulses;
+		std::vector<ContactEvent> touching;
+		std::vector<SensorEvent> sensorOverlaps;
+	};
+
+	[[nodiscard]] std::size_t SlotAt(std::size_t age) const; // age 0 is the newest frame
+	static void EncodeDelta(const std::vector<uint32_t>& older, const std::vector<uint32_t>& newer, std::vector<uint32_t>& out);
+	static void ApplyDelta(const std::vector<uint32_t>& delta, std::vector<uint32_t>& words);
+
+	std::vector<Frame> m_frames;
+	std::size_t m_newest = 0;
+	std::size_t m_count = 0;
+	bool m_deltaCompression;
+
+	std::vector<uint32_t> m_scratch;
+	std::vector<uint32_t> m_delta;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Vec2.h"
+
+// What SAT found for a polygon pair on the last step, tested first on the next one.
+// A separating axis is kept as long as it still separates. A reference edge is kept while the pair has not moved enough
+// since to separate, or to put another axis more than SAT_CACHE_TOLERANCE ahead of it. Resting boxes have two almost
+// equal faces (the floor's and their own), keeping the same one also stops the contact from flipping between them.
+struct SatCache
+{
+	bool isValid = false;
+	bool isSeparating = false; // The edge separates the pair, else it is the reference edge of the contact
+	bool isEdgeOfA = false;
+	int edge = 0;
+	float separation = 0.0f; // Separation along the reference edge
+	float lead = 0.0f; // How far the reference edge was ahead of the next best axis
+	Vec2 relativePosition; // Position and rotation of b in the frame of a when the reference edge was found
+	float relativeRotation = 0.0f;
+};
+
+// How much less deep than the best axis the cached reference edge may get, in pixels
+constexpr float SAT_CACHE_TOLERANCE = 0.1f;
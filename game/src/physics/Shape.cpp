@@ -1,8 +1,91 @@
 ﻿#include "physics/Shape.h"
+#include "physics/Simd.h"
 #include "physics/Vec2.h"
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
+namespace
+{
+	// Smallest projection of the vertices on a normal, relative to a point of the edge. The count is a multiple of 4.
+	float MinProjection(const float* xs, const float* ys, const std::size_t count, const Vec2& point, const Vec2& normal)
+	{
+#ifdef PHYSICS_USE_SSE2
+		const __m128 px = _mm_set1_ps(point.x);
+		const __m128 py = _mm_set1_ps(point.y);
+		const __m128 nx = _mm_set1_ps(normal.x);
+		const __m128 ny = _mm_set1_ps(normal.y);
+
+		__m128 minProj = _mm_set1_ps(std::numeric_limits<float>::max());
+		for (std::size_t i = 0; i < count; i += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), px);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), py);
+			minProj = _mm_min_ps(minProj, _mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)));
+		}
+
+		// Reduce the 4 lanes
+		minProj = _mm_min_ps(minProj, _mm_shuffle_ps(minProj, minProj, _MM_SHUFFLE(2, 3, 0, 1)));
+		minProj = _mm_min_ps(minProj, _mm_shuffle_ps(minProj, minProj, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(minProj);
+#else
+		float minProj = std::numeric_limits<float>::max();
+		for (std::size_t i = 0; i < count; i++)
+			minProj = std::min(minProj, (xs[i] - point.x) * normal.x + (ys[i] - point.y) * normal.y);
+
+		return minProj;
+#endif
+	}
+
+	// First point where the ray enters a circle, false when it misses it or starts inside
+	bool RayCastCircle(const Vec2& center, const float radius, const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal)
+	{
+		const Vec2 offset = start - center;
+		const float c = offset.MagnitudeSquared() - radius * radius;
+		if (c <= 0.0f)
+			return false;
+
+		// Smallest root of |offset + t * delta|^2 = radius^2
+		const Vec2 delta = end - start;
+		const float a = delta.MagnitudeSquared();
+		const float b = offset.Dot(delta);
+		const float discriminant = b * b - a * c;
+		if (a <= 0.0f || discriminant < 0.0f)
+			return false;
+
+		const float t = -(b + std::sqrt(discriminant)) / a;
+		if (t < 0.0f || t > 1.0f)
+			return false;
+
+		outFraction = t;
+		outNormal = (offset + delta * t).Normalize();
+		return true;
+	}
+
+	// Crossing of the ray with the side from p0 to p1, only from the side its normal faces
+	bool RayCastSide(const Vec2& p0, const Vec2& p1, const Vec2& normal, const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal)
+	{
+		const Vec2 delta = end - start;
+		const float denominator = delta.Dot(normal);
+		if (denominator >= 0.0f)
+			return false;
+
+		const float t = (p0 - start).Dot(normal) / denominator;
+		if (t < 0.0f || t > 1.0f)
+			return false;
+
+		const Vec2 side = p1 - p0;
+		const float along = (start + delta * t - p0).Dot(side);
+		if (along < 0.0f || along > side.MagnitudeSquared())
+			return false;
+
+		outFraction = t;
+		outNormal = normal;
+		return true;
+	}
+}
+
 CircleShape::CircleShape(const float radius)
 {
 	m_radius = radius;
@@ -18,13 +101,34 @@ std::unique_ptr<Shape> CircleShape::Clone() const
 	return std::make_unique<CircleShape>(m_radius);
 }
 
-void CircleShape::UpdateVertices(const Vec2& position, float angle) {}
+void CircleShape::UpdateVertices(const Vec2& position, float /*angle*/)
+{
+	m_worldCenter = position;
+
+	const Vec2 extent(m_radius, m_radius);
+	m_box = {position - extent, position + extent};
+}
 
 float CircleShape::GetMomentOfInertia() const
 {
 	return 0.5f * (m_radius * m_radius);
 }
 
+ConvexProxy CircleShape::GetProxy() const
+{
+	return {&m_worldCenter, 1, m_radius};
+}
+
+bool CircleShape::TestPoint(const Vec2& point) const
+{
+	return (point - m_worldCenter).MagnitudeSquared() <= m_radius * m_radius;
+}
+
+bool CircleShape::RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const
+{
+	return RayCastCircle(m_worldCenter, m_radius, start, end, outFraction, outNormal);
+}
+
 PolygonShape::PolygonShape(const std::vector<Vec2>& vertices)
 {
 	float minX = std::numeric_limits<float>::max();
@@ -47,6 +151,8 @@ PolygonShape::PolygonShape(const std::vector<Vec2>& vertices)
 
 	m_width = static_cast<int>(maxX - minX);
 	m_height = static_cast<int>(maxY - minY);
+
+	InitializeEdges();
 }
 
 ShapeType PolygonShape::GetType() const
@@ -83,9 +189,108 @@ void PolygonShape::UpdateVertices(const Vec2& position, const float angle)
 		// We rotate first and then we do the translation
 		m_worldVertices[i] = m_localVertices[i].Rotate(angle);
 		m_worldVertices[i] += position;
+
+		// Grow the bounding box with the world vertices
+		if (i == 0)
+		{
+			m_box = {m_worldVertices[i], m_worldVertices[i]};
+		}
+		else
+		{
+			m_box.min = Vec2(std::min(m_box.min.x, m_worldVertices[i].x), std::min(m_box.min.y, m_worldVertices[i].y));
+			m_box.max = Vec2(std::max(m_box.max.x, m_worldVertices[i].x), std::max(m_box.max.y, m_worldVertices[i].y));
+		}
+	}
+
+	// Normals only rotate, they keep their length
+	const float c = cos(angle);
+	const float s = sin(angle);
+	for (size_t i = 0; i < m_localNormals.size(); i++)
+	{
+		m_worldNormalsX[i] = m_localNormals[i].x * c - m_localNormals[i].y * s;
+		m_worldNormalsY[i] = m_localNormals[i].x * s + m_localNormals[i].y * c;
+	}
+
+	for (size_t i = 0; i < m_worldVerticesX.size(); i++)
+	{
+		const Vec2& vertex = m_worldVertices[std::min(i, m_worldVertices.size() - 1)];
+		m_worldVerticesX[i] = vertex.x;
+		m_worldVerticesY[i] = vertex.y;
 	}
 }
 
+void PolygonShape::InitializeEdges()
+{
+	m_localNormals.clear();
+	for (size_t i = 0; i < m_localVertices.size(); i++)
+		m_localNormals.push_back((m_localVertices[(i + 1) % m_localVertices.size()] - m_localVertices[i]).Perpendicular());
+
+	const size_t paddedCount = (m_localVertices.size() + 3) / 4 * 4;
+	m_worldVerticesX.assign(paddedCount, 0.0f);
+	m_worldVerticesY.assign(paddedCount, 0.0f);
+	m_worldNormalsX.assign(m_localNormals.size(), 0.0f);
+	m_worldNormalsY.assign(m_localNormals.size(), 0.0f);
+}
+
+ConvexProxy PolygonShape::GetProxy() const
+{
+	return {m_worldVertices.data(), static_cast<int>(m_worldVertices.size()), 0.0f};
+}
+
+bool PolygonShape::TestPoint(const Vec2& point) const
+{
+	for (std::size_t i = 0; i < m_worldVertices.size(); i++)
+	{
+		if (NormalAt(i).Dot(point - m_worldVertices[i]) > 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+bool PolygonShape::RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const
+{
+	// Clip the ray against the half plane of every edge, it enters the polygon on the last edge it crosses inwards
+	const Vec2 delta = end - start;
+	float lower = 0.0f;
+	float upper = 1.0f;
+	int entryEdge = -1;
+
+	for (std::size_t i = 0; i < m_worldVertices.size(); i++)
+	{
+		const Vec2 normal = NormalAt(i);
+		const float numerator = normal.Dot(m_worldVertices[i] - start);
+		const float denominator = normal.Dot(delta);
+
+		if (denominator == 0.0f)
+		{
+			// Parallel to the edge and outside of it
+			if (numerator < 0.0f)
+				return false;
+		}
+		else if (denominator < 0.0f && numerator < lower * denominator)
+		{
+			lower = numerator / denominator;
+			entryEdge = static_cast<int>(i);
+		}
+		else if (denominator > 0.0f && numerator < upper * denominator)
+		{
+			upper = numerator / denominator;
+		}
+
+		if (upper < lower)
+			return false;
+	}
+
+	// No edge crossed inwards, the ray starts inside
+	if (entryEdge < 0)
+		return false;
+
+	outFraction = lower;
+	outNormal = NormalAt(entryEdge);
+	return true;
+}
+
 Vec2 PolygonShape::EdgeAt(const size_t index) const
 {
 	const size_t currVertex = index;
@@ -93,41 +298,61 @@ Vec2 PolygonShape::EdgeAt(const size_t index) const
 	return m_worldVertices[nextVertex] - m_worldVertices[currVertex];
 }
 
+Vec2 PolygonShape::NormalAt(const size_t index) const
+{
+	return Vec2(m_worldNormalsX[index], m_worldNormalsY[index]);
+}
+
 float PolygonShape::FindMinSeparation(const PolygonShape* other, int& indexReferenceEdge, Vec2& supportPoint) const
+{
+	float nextSeparation;
+	return FindMinSeparation(other, indexReferenceEdge, supportPoint, nextSeparation);
+}
+
+float PolygonShape::FindMinSeparation(const PolygonShape* other, int& indexReferenceEdge, Vec2& supportPoint, float& nextSeparation) const
 {
 	float separation = std::numeric_limits<float>::lowest();
+	nextSeparation = std::numeric_limits<float>::lowest();
 
-	// Loop all the vertices of "this" polygon
+	// Loop all the edges of "this" polygon, projecting all the vertices of the "other" polygon on their normal
 	for (size_t i = 0; i < this->m_worldVertices.size(); i++)
 	{
-		Vec2 va = this->m_worldVertices[i];
-		Vec2 normal = this->EdgeAt(i).Perpendicular();
-
-		// Loop all the vertices of the "other" polygon
-		float minSep = std::numeric_limits<float>::max();
-		Vec2 minVertex;
-
-		for (const auto& vb : other->m_worldVertices)
-		{
-			const float proj = (vb - va).Dot(normal);
-			if (proj < minSep)
-			{
-				minSep = proj;
-				minVertex = vb;
-			}
-		}
-
+		const float minSep = FindEdgeSeparation(other, i);
 		if (minSep > separation)
 		{
+			nextSeparation = separation;
 			separation = minSep;
 			indexReferenceEdge = static_cast<int>(i);
-			supportPoint = minVertex;
+		}
+		else
+		{
+			nextSeparation = std::max(nextSeparation, minSep);
+		}
+	}
+
+	// The support point is the deepest vertex along the best edge only
+	const Vec2 va = this->m_worldVertices[indexReferenceEdge];
+	const Vec2 normal = NormalAt(indexReferenceEdge);
+	float minProj = std::numeric_limits<float>::max();
+	for (const auto& vb : other->m_worldVertices)
+	{
+		const float proj = (vb - va).Dot(normal);
+		if (proj < minProj)
+		{
+			minProj = proj;
+			supportPoint = vb;
 		}
 	}
 
 	return separation;
 }
 
+float PolygonShape::FindEdgeSeparation(const PolygonShape* other, const size_t index) const
+{
+	return MinProjection(other->m_worldVerticesX.data(), other->m_worldVerticesY.data(), other->m_worldVerticesX.size(),
+	                     m_worldVertices[index], NormalAt(index));
+}
+
 int PolygonShape::FindIncidentEdge(const Vec2& normal) const
 {
 	int indexIncidentEdge = 0;
@@ -135,8 +360,7 @@ int PolygonShape::FindIncidentEdge(const Vec2& normal) const
 
 	for (size_t i = 0; i < this->m_worldVertices.size(); ++i)
 	{
-		const Vec2 edgeNormal = this->EdgeAt(i).Perpendicular();
-		const float proj = edgeNormal.Dot(normal);
+		const float proj = m_worldNormalsX[i] * normal.x + m_worldNormalsY[i] * normal.y;
 		if (proj < minProj)
 		{
 			minProj = proj;
@@ -197,6 +421,8 @@ BoxShape::BoxShape(const int width, const int height)
 	m_worldVertices.emplace_back(+fWidth / 2.0f, -fHeight / 2.0f);
 	m_worldVertices.emplace_back(+fWidth / 2.0f, +fHeight / 2.0f);
 	m_worldVertices.emplace_back(-fWidth / 2.0f, +fHeight / 2.0f);
+
+	InitializeEdges();
 }
 
 ShapeType BoxShape::GetType() const
@@ -213,3 +439,128 @@ float BoxShape::GetMomentOfInertia() const
 {
 	return (1 / 12.0f) * static_cast<float>(m_width * m_width + m_height * m_height);
 }
+
+CapsuleShape::CapsuleShape(const float halfLength, const float radius)
+{
+	m_halfLength = halfLength;
+	m_radius = radius;
+	m_localVertices[0] = Vec2(-halfLength, 0.0f);
+	m_localVertices[1] = Vec2(halfLength, 0.0f);
+	m_worldVertices[0] = m_localVertices[0];
+	m_worldVertices[1] = m_localVertices[1];
+}
+
+ShapeType CapsuleShape::GetType() const
+{
+	return CAPSULE;
+}
+
+std::unique_ptr<Shape> CapsuleShape::Clone() const
+{
+	return std::make_unique<CapsuleShape>(m_halfLength, m_radius);
+}
+
+void CapsuleShape::UpdateVertices(const Vec2& position, const float angle)
+{
+	for (int i = 0; i < 2; i++)
+		m_worldVertices[i] = m_localVertices[i].Rotate(angle) + position;
+
+	const Vec2 extent(m_radius, m_radius);
+	m_box.min = Vec2(std::min(m_worldVertices[0].x, m_worldVertices[1].x), std::min(m_worldVertices[0].y, m_worldVertices[1].y)) - extent;
+	m_box.max = Vec2(std::max(m_worldVertices[0].x, m_worldVertices[1].x), std::max(m_worldVertices[0].y, m_worldVertices[1].y)) + extent;
+}
+
+float CapsuleShape::GetMomentOfInertia() const
+{
+	// A box between the two half discs, the mass is shared by area
+	const float boxArea = 4.0f * m_halfLength * m_radius;
+	const float discArea = 3.14159265f * m_radius * m_radius;
+	const float boxInertia = (1 / 12.0f) * (4.0f * m_halfLength * m_halfLength + 4.0f * m_radius * m_radius);
+
+	// Each half disc has its centroid 4r/3pi past the end of the segment
+	const float centroidOffset = 4.0f * m_radius / (3.0f * 3.14159265f);
+	const float discInertia = 0.5f * m_radius * m_radius + m_halfLength * m_halfLength + 2.0f * m_halfLength * centroidOffset;
+
+	return (boxArea * boxInertia + discArea * discInertia) / (boxArea + discArea);
+}
+
+ConvexProxy CapsuleShape::GetProxy() const
+{
+	return {m_worldVertices, 2, m_radius};
+}
+
+bool CapsuleShape::TestPoint(const Vec2& point) const
+{
+	const Vec2 axis = m_worldVertices[1] - m_worldVertices[0];
+	const float lengthSquared = axis.MagnitudeSquared();
+	const float t = lengthSquared > 0.0f ? std::clamp((point - m_worldVertices[0]).Dot(axis) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+
+	// A segment has no inside
+	const Vec2 closest = m_worldVertices[0] + axis * t;
+	return m_radius > 0.0f && (point - closest).MagnitudeSquared() <= m_radius * m_radius;
+}
+
+bool CapsuleShape::RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const
+{
+	if (TestPoint(start))
+		return false;
+
+	// The capsule is the union of the end circles and the box between them, the ray enters it where it enters the first
+	// of them. It can only enter the box through its long sides, its short ones are inside the circles.
+	const Vec2 normal = (m_worldVertices[1] - m_worldVertices[0]).Perpendicular();
+	const Vec2 offset = normal * m_radius;
+
+	float fraction;
+	Vec2 hitNormal;
+	bool isHit = false;
+	outFraction = std::numeric_limits<float>::max();
+
+	const auto keepClosest = [&](const bool isCandidateHit)
+	{
+		if (isCandidateHit && fraction < outFraction)
+		{
+			outFraction = fraction;
+			outNormal = hitNormal;
+			isHit = true;
+		}
+	};
+
+	keepClosest(RayCastSide(m_worldVertices[0] + offset, m_worldVertices[1] + offset, normal, start, end, fraction, hitNormal));
+	keepClosest(RayCastSide(m_worldVertices[0] - offset, m_worldVertices[1] - offset, -normal, start, end, fraction, hitNormal));
+
+	if (m_radius > 0.0f)
+	{
+		keepClosest(RayCastCircle(m_worldVertices[0], m_radius, start, end, fraction, hitNormal));
+		keepClosest(RayCastCircle(m_worldVertices[1], m_radius, start, end, fraction, hitNormal));
+	}
+
+	return isHit;
+}
+
+float CapsuleShape::GetWidth() const
+{
+	return 2.0f * (m_halfLength + m_radius);
+}
+
+float CapsuleShape::GetHeight() const
+{
+	return 2.0f * m_radius;
+}
+
+SegmentShape::SegmentShape(const float halfLength) : CapsuleShape(halfLength, 0.0f) {}
+
+ShapeType SegmentShape::GetType() const
+{
+	return SEGMENT;
+}
+
+std::unique_ptr<Shape> SegmentShape::Clone() const
+{
+	return std::make_unique<SegmentShape>(m_halfLength);
+}
+
+float SegmentShape::GetMomentOfInertia() const
+{
+	// Thin rod
+	return (1 / 12.0f) * (4.0f * m_halfLength * m_halfLength);
+}
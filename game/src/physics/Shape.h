@@ -3,13 +3,40 @@
 #include <memory>
 #include <vector>
 
-struct Vec2;
+#include "AABB.h"
 
 enum ShapeType : uint8_t
 {
 	CIRCLE,
 	POLYGON,
-	BOX
+	BOX,
+	CAPSULE,
+	SEGMENT
+};
+
+// Convex shape seen by the GJK distance: the convex hull of a few world space points, rounded by a radius
+struct ConvexProxy
+{
+	const Vec2* vertices;
+	int count;
+	float radius;
+
+	[[nodiscard]] int Support(const Vec2& direction) const
+	{
+		int best = 0;
+		float bestProjection = vertices[0].Dot(direction);
+		for (int i = 1; i < count; i++)
+		{
+			const float projection = vertices[i].Dot(direction);
+			if (projection > bestProjection)
+			{
+				best = i;
+				bestProjection = projection;
+			}
+		}
+
+		return best;
+	}
 };
 
 class Shape
@@ -19,6 +46,14 @@ public:
 	[[nodiscard]] virtual std::unique_ptr<Shape> Clone() const = 0;
 	virtual void UpdateVertices(const Vec2& position, float angle) = 0;
 	[[nodiscard]] virtual float GetMomentOfInertia() const = 0;
+	[[nodiscard]] virtual ConvexProxy GetProxy() const = 0;
+
+	// Tests against the world vertices. A ray starting inside the shape does not hit it, a segment contains no point.
+	[[nodiscard]] virtual bool TestPoint(const Vec2& point) const = 0;
+	// First point where the ray from start to end enters the shape, as a fraction of the ray, with the surface normal there
+	virtual bool RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const = 0;
+
+	AABB m_box; // World space bounding box, updated with the vertices
 
 	Shape() = default;
 	virtual ~Shape() = default;
@@ -32,12 +67,16 @@ class CircleShape final : public Shape
 {
 public:
 	float m_radius;
+	Vec2 m_worldCenter; // Updated with the vertices
 
 	explicit CircleShape(float radius);
 	[[nodiscard]] ShapeType GetType() const override;
 	[[nodiscard]] std::unique_ptr<Shape> Clone() const override;
 	void UpdateVertices(const Vec2& position, float angle) override;
 	[[nodiscard]] float GetMomentOfInertia() const override;
+	[[nodiscard]] ConvexProxy GetProxy() const override;
+	[[nodiscard]] bool TestPoint(const Vec2& point) const override;
+	bool RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const override;
 
 	CircleShape() = default;
 	~CircleShape() override = default;
@@ -54,15 +93,31 @@ public:
 	int m_height;
 	std::vector<Vec2> m_localVertices;
 	std::vector<Vec2> m_worldVertices;
+	std::vector<Vec2> m_localNormals; // Outward normal of the edge starting at each vertex
+
+	// World vertices and edge normals again as x and y arrays for the SAT kernel. The vertex arrays are padded to a multiple
+	// of 4 with the last vertex, so the projections always run on full SIMD lanes.
+	std::vector<float> m_worldVerticesX;
+	std::vector<float> m_worldVerticesY;
+	std::vector<float> m_worldNormalsX;
+	std::vector<float> m_worldNormalsY;
 
 	explicit PolygonShape(const std::vector<Vec2>& vertices);
 	[[nodiscard]] ShapeType GetType() const override;
 	[[nodiscard]] std::unique_ptr<Shape> Clone() const override;
 	[[nodiscard]] float GetMomentOfInertia() const override;
 	void UpdateVertices(const Vec2& position, float angle) override;
+	[[nodiscard]] ConvexProxy GetProxy() const override;
+	[[nodiscard]] bool TestPoint(const Vec2& point) const override;
+	bool RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const override;
 
 	[[nodiscard]] Vec2 EdgeAt(std::size_t index) const;
+	[[nodiscard]] Vec2 NormalAt(std::size_t index) const;
 	float FindMinSeparation(const PolygonShape* other, int& indexReferenceEdge, Vec2& supportPoint) const;
+	// Also gives the separation on the runner up edge
+	float FindMinSeparation(const PolygonShape* other, int& indexReferenceEdge, Vec2& supportPoint, float& nextSeparation) const;
+	// Separation of the other polygon along the normal of one edge
+	[[nodiscard]] float FindEdgeSeparation(const PolygonShape* other, std::size_t index) const;
 	[[nodiscard]] int FindIncidentEdge(const Vec2& normal) const;
 	static int ClipSegmentToLine(const std::vector<Vec2>& contactsIn, std::vector<Vec2>& contactsOut, const Vec2& c0, const Vec2& c1);
 
@@ -72,6 +127,10 @@ public:
 	PolygonShape& operator = (const PolygonShape& shape) = delete;
 	PolygonShape(PolygonShape&& shape) = delete;
 	PolygonShape& operator = (PolygonShape&& shape) = delete;
+
+protected:
+	// Computes the local normals and sizes the world arrays, once the local vertices are set
+	void InitializeEdges();
 };
 
 class BoxShape final : public PolygonShape
@@ -89,3 +148,50 @@ public:
 	BoxShape(BoxShape&& shape) = delete;
 	BoxShape& operator = (BoxShape&& shape) = delete;
 };
+
+// Segment along the local x axis, rounded by a radius
+class CapsuleShape : public Shape
+{
+public:
+	float m_halfLength;
+	float m_radius;
+	Vec2 m_localVertices[2];
+	Vec2 m_worldVertices[2];
+
+	CapsuleShape(float halfLength, float radius);
+	[[nodiscard]] ShapeType GetType() const override;
+	[[nodiscard]] std::unique_ptr<Shape> Clone() const override;
+	void UpdateVertices(const Vec2& position, float angle) override;
+	[[nodiscard]] float GetMomentOfInertia() const override;
+	[[nodiscard]] ConvexProxy GetProxy() const override;
+	[[nodiscard]] bool TestPoint(const Vec2& point) const override;
+	bool RayCast(const Vec2& start, const Vec2& end, float& outFraction, Vec2& outNormal) const override;
+
+	// Width and height of the capsule, for the textures
+	[[nodiscard]] float GetWidth() const;
+	[[nodiscard]] float GetHeight() const;
+
+	CapsuleShape() = default;
+	~CapsuleShape() override = default;
+	CapsuleShape(const CapsuleShape& shape) = delete;
+	CapsuleShape& operator =(const CapsuleShape& shape) = delete;
+	CapsuleShape(CapsuleShape&& shape) = delete;
+	CapsuleShape& operator = (CapsuleShape&& shape) = delete;
+};
+
+// Capsule without radius
+class SegmentShape final : public CapsuleShape
+{
+public:
+	explicit SegmentShape(float halfLength);
+	[[nodiscard]] ShapeType GetType() const override;
+	[[nodiscard]] std::unique_ptr<Shape> Clone() const override;
+	[[nodiscard]] float GetMomentOfInertia() const override;
+
+	SegmentShape() = default;
+	~SegmentShape() override = default;
+	SegmentShape(const SegmentShape& shape) = delete;
+	SegmentShape& operator =(const SegmentShape& shape) = delete;
+	SegmentShape(SegmentShape&& shape) = delete;
+	SegmentShape& operator = (SegmentShape&& shape) = delete;
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+// SSE2 is always there on x64, the kernels fall back to scalar code elsewhere
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PHYSICS_USE_SSE2
+#endif
@@ -0,0 +1,441 @@
+#include "physics/Snapshot.h"
+#include "memory/Arena.h"
+#include "memory/MappedFile.h"
+#include "physics/Constraint.h"
+#include "physics/RigidBody.h"
+#include "physics/Shape.h"
+#include "physics/World.h"
+
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	constexpr std::size_t SECTION_ALIGNMENT = 16;
+
+	template <typename T>
+	void WriteSection(std::vector<unsigned char>& buffer, SnapshotHeader& header, const SnapshotSection section, const T* data, const std::size_t count)
+	{
+		// Pad with zeros up to the next aligned offset
+		const std::size_t offset = (buffer.size() + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+		buffer.resize(offset + count * sizeof(T), 0);
+		header.sectionOffsets[section] = offset;
+
+		if (count > 0)
+			memcpy(&buffer[offset], data, count * sizeof(T));
+	}
+
+	template <typename T>
+	void WriteBodyField(std::vector<unsigned char>& buffer, SnapshotHeader& header, const SnapshotSection section, const std::vector<RigidBody*>& bodies, T RigidBody::* field)
+	{
+		std::vector<T> values;
+		values.reserve(bodies.size());
+
+		for (const auto body : bodies)
+			values.push_back(body->*field);
+
+		WriteSection(buffer, header, section, values.data(), values.size());
+	}
+
+	// Returns a pointer to the section inside the mapped file, or nullptr if it does not fit in the file
+	template <typename T>
+	const T* ReadSection(const MappedFile& file, const SnapshotHeader& header, const SnapshotSection section, const std::size_t count)
+	{
+		const uint64_t offset = header.sectionOffsets[section];
+		if (offset % alignof(T) != 0 || offset > file.Size() || count * sizeof(T) > file.Size() - offset)
+			return nullptr;
+
+		return reinterpret_cast<const T*>(file.Data() + offset);
+	}
+
+	std::unique_ptr<Shape> CreateShape(const SnapshotShape& record, const Vec2* vertices, const uint32_t vertexCount)
+	{
+		switch (record.type)
+		{
+		case CIRCLE:
+			return std::make_unique<CircleShape>(record.radius);
+		case BOX:
+			return std::make_unique<BoxShape>(record.width, record.height);
+		case POLYGON:
+			if (record.firstVertex > vertexCount || record.vertexCount > vertexCount - record.firstVertex)
+				return nullptr;
+			return std::make_unique<PolygonShape>(std::vector<Vec2>(vertices + record.firstVertex, vertices + record.firstVertex + record.vertexCount));
+		case CAPSULE:
+			return std::make_unique<CapsuleShape>(record.halfLength, record.radius);
+		case SEGMENT:
+			return std::make_unique<SegmentShape>(record.halfLength);
+		default:
+			return nullptr;
+		}
+	}
+}
+
+bool Snapshot::Save(const World& world, const std::string& path)
+{
+	const auto& bodies = world.GetBodies();
+	const auto& joints = world.GetConstraints();
+
+	SnapshotHeader header{};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.gravity = world.GetGravity();
+	header.solver = world.GetSolver();
+	header.positionCorrection = world.GetPositionCorrection();
+	header.solverOrder = world.GetSolverOrder();
+	header.substeps = world.GetSubsteps();
+	header.iterations = world.GetIterations();
+	header.positionIterations = world.GetPositionIterations();
+	header.tolerance = world.GetTolerance();
+	header.lodTick = world.GetLodTick();
+	header.bodyCount = static_cast<uint32_t>(bodies.size());
+	header.jointCount = static_cast<uint32_t>(joints.size());
+	header.forceCount = static_cast<uint32_t>(world.GetForces().size());
+	header.torqueCount = static_cast<uint32_t>(world.GetTorques().size());
+
+	std::vector<unsigned char> buffer(sizeof(SnapshotHeader), 0);
+
+	WriteBodyField(buffer, header, SECTION_POSITIONS, bodies, &RigidBody::m_position);
+	WriteBodyField(buffer, header, SECTION_VELOCITIES, bodies, &RigidBody::m_velocity);
+	WriteBodyField(buffer, header, SECTION_ACCELERATIONS, bodies, &RigidBody::m_acceleration);
+	WriteBodyField(buffer, header, SECTION_SUM_FORCES, bodies, &RigidBody::m_sumForces);
+	WriteBodyField(buffer, header, SECTION_ROTATIONS, bodies, &RigidBody::m_rotation);
+	WriteBodyField(buffer, header, SECTION_ANGULAR_VELOCITIES, bodies, &RigidBody::m_angularVelocity);
+	WriteBodyField(buffer, header, SECTION_ANGULAR_ACCELERATIONS, bodies, &RigidBody::m_angularAcceleration);
+	WriteBodyField(buffer, header, SECTION_SUM_TORQUES, bodies, &RigidBody::m_sumTorque);
+	WriteBodyField(buffer, header, SECTION_MASSES, bodies, &RigidBody::m_mass);
+	WriteBodyField(buffer, header, SECTION_INV_MASSES, bodies, &RigidBody::m_invMass);
+	WriteBodyField(buffer, header, SECTION_INERTIAS, bodies, &RigidBody::m_inertia);
+	WriteBodyField(buffer, header, SECTION_INV_INERTIAS, bodies, &RigidBody::m_invInertia);
+	WriteBodyField(buffer, header, SECTION_RESTITUTIONS, bodies, &RigidBody::m_restitution);
+	WriteBodyField(buffer, header, SECTION_FRICTIONS, bodies, &RigidBody::m_friction);
+
+	// Flags are stored as bytes, a vector of bool is packed and has no data
+	std::vector<uint8_t> bullets;
+	std::vector<uint8_t> sensors;
+	bullets.reserve(bodies.size());
+	sensors.reserve(bodies.size());
+	for (const auto body : bodies)
+	{
+		bullets.push_back(body->m_isBullet ? 1 : 0);
+		sensors.push_back(body->m_isSensor ? 1 : 0);
+	}
+
+	WriteSection(buffer, header, SECTION_BULLETS, bullets.data(), bullets.size());
+	WriteSection(buffer, header, SECTION_SENSORS, sensors.data(), sensors.size());
+	WriteBodyField(buffer, header, SECTION_FILTERS, bodies, &RigidBody::m_filter);
+
+	// Shapes reference a shared vertex array, only the local vertices are stored as the world ones are derived
+	std::vector<SnapshotShape> shapes;
+	std::vector<Vec2> vertices;
+	shapes.reserve(bodies.size());
+
+	for (const auto body : bodies)
+	{
+		SnapshotShape shape{};
+		shape.type = body->m_shape->GetType();
+
+		if (shape.type == CIRCLE)
+		{
+			shape.radius = dynamic_cast<const CircleShape*>(body->m_shape.get())->m_radius;
+		}
+		else if (shape.type == CAPSULE || shape.type == SEGMENT)
+		{
+			const auto* capsuleShape = dynamic_cast<const CapsuleShape*>(body->m_shape.get());
+			shape.radius = capsuleShape->m_radius;
+			shape.halfLength = capsuleShape->m_halfLength;
+		}
+		else
+		{
+			const auto* polygonShape = dynamic_cast<const PolygonShape*>(body->m_shape.get());
+			shape.width = polygonShape->m_width;
+			shape.height = polygonShape->m_height;
+			shape.firstVertex = static_cast<uint32_t>(vertices.size());
+			shape.vertexCount = static_cast<uint32_t>(polygonShape->m_localVertices.size());
+			vertices.insert(vertices.end(), polygonShape->m_localVertices.begin(), polygonShape->m_localVertices.end());
+		}
+
+		shapes.push_back(shape);
+	}
+
+	header.vertexCount = static_cast<uint32_t>(vertices.size());
+	WriteSection(buffer, header, SECTION_SHAPES, shapes.data(), shapes.size());
+	WriteSection(buffer, header, SECTION_VERTICES, vertices.data(), vertices.size());
+
+	// Joints reference bodies by their index in the world
+	std::unordered_map<const RigidBody*, uint32_t> bodyIndices;
+	for (uint32_t i = 0; i < header.bodyCount; i++)
+		bodyIndices.emplace(bodies[i], i);
+
+	std::vector<SnapshotJoint> jointRecords;
+	jointRecords.reserve(joints.size());
+
+	for (const auto joint : joints)
+	{
+		const auto foundA = bodyIndices.find(joint->a);
+		const auto foundB = bodyIndices.find(joint->b);
+		if (foundA == bodyIndices.end() || foundB == bodyIndices.end())
+			return false;
+
+		SnapshotJoint record{};
+		record.a = foundA->second;
+		record.b = foundB->second;
+		record.aPoint[0] = joint->aPoint.x;
+		record.aPoint[1] = joint->aPoint.y;
+		record.bPoint[0] = joint->bPoint.x;
+		record.bPoint[1] = joint->bPoint.y;
+		record.cachedLambda = joint->GetCachedLambda(0);
+		record.collideConnected = joint->collideConnected ? 1 : 0;
+		jointRecords.push_back(record);
+	}
+
+	WriteSection(buffer, header, SECTION_JOINTS, jointRecords.data(), jointRecords.size());
+
+	std::vector<SatCacheRecord> satCache;
+	world.GetSatCache(satCache);
+
+	std::vector<SnapshotSatCache> satCacheRecords;
+	satCacheRecords.reserve(satCache.size());
+	for (const auto& entry : satCache)
+	{
+		SnapshotSatCache record{};
+		record.a = bodyIndices.at(entry.a);
+		record.b = bodyIndices.at(entry.b);
+		record.cache = entry.cache;
+		satCacheRecords.push_back(record);
+	}
+
+	header.satCacheCount = static_cast<uint32_t>(satCacheRecords.size());
+	WriteSection(buffer, header, SECTION_SAT_CACHE, satCacheRecords.data(), satCacheRecords.size());
+
+	std::vector<ContactImpulseRecord> contactImpulses;
+	world.GetContactImpulses(contactImpulses);
+
+	std::vector<SnapshotContactImpulse> contactImpulseRecords;
+	contactImpulseRecords.reserve(contactImpulses.size());
+	for (const auto& entry : contactImpulses)
+		contactImpulseRecords.push_back({bodyIndices.at(entry.a), bodyIndices.at(entry.b), entry.offset, entry.normalImpulse});
+
+	header.contactImpulseCount = static_cast<uint32_t>(contactImpulseRecords.size());
+	WriteSection(buffer, header, SECTION_CONTACT_IMPULSES, contactImpulseRecords.data(), contactImpulseRecords.size());
+
+	std::vector<SnapshotContact> touchingRecords;
+	touchingRecords.reserve(world.GetTouching().size());
+	for (const auto& event : world.GetTouching())
+		touchingRecords.push_back({bodyIndices.at(event.a), bodyIndices.at(event.b), event.point, event.normal, event.maxNormalImpulse});
+
+	header.touchingCount = static_cast<uint32_t>(touchingRecords.size());
+	WriteSection(buffer, header, SECTION_TOUCHING, touchingRecords.data(), touchingRecords.size());
+
+	std::vector<SnapshotSensorOverlap> sensorOverlapRecords;
+	sensorOverlapRecords.reserve(world.GetSensorOverlaps().size());
+	for (const auto& pair : world.GetSensorOverlaps())
+		sensorOverlapRecords.push_back({bodyIndices.at(pair.sensor), bodyIndices.at(pair.visitor)});
+
+	header.sensorOverlapCount = static_cast<uint32_t>(sensorOverlapRecords.size());
+	WriteSection(buffer, header, SECTION_SENSOR_OVERLAPS, sensorOverlapRecords.data(), sensorOverlapRecords.size());
+	WriteSection(buffer, header, SECTION_FORCES, world.GetForces().data(), world.GetForces().size());
+	WriteSection(buffer, header, SECTION_TORQUES, world.GetTorques().data(), world.GetTorques().size());
+
+	// Texture ids are packed in a single char array, body i owns the range [offsets[i], offsets[i + 1])
+	std::vector<uint32_t> textureOffsets;
+	std::string textureChars;
+	textureOffsets.reserve(bodies.size() + 1);
+
+	for (const auto body : bodies)
+	{
+		textureOffsets.push_back(static_cast<uint32_t>(textureChars.size()));
+		textureChars += body->m_textureId;
+	}
+	textureOffsets.push_back(static_cast<uint32_t>(textureChars.size()));
+
+	header.textureChars = static_cast<uint32_t>(textureChars.size());
+	WriteSection(buffer, header, SECTION_TEXTURE_OFFSETS, textureOffsets.data(), textureOffsets.size());
+	WriteSection(buffer, header, SECTION_TEXTURE_CHARS, textureChars.data(), textureChars.size());
+
+	header.fileSize = buffer.size();
+	memcpy(buffer.data(), &header, sizeof(SnapshotHeader));
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false)
+		return false;
+
+	file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+	return file.good();
+}
+
+std::unique_ptr<World> Snapshot::Load(const std::string& path, Arena& bodyArena, Arena& constraintArena)
+{
+	MappedFile file;
+	if (file.Open(path) == false || file.Size() < sizeof(SnapshotHeader))
+		return nullptr;
+
+	SnapshotHeader header;
+	memcpy(&header, file.Data(), sizeof(SnapshotHeader));
+
+	if (header.magic != MAGIC || header.version != VERSION || header.fileSize != file.Size())
+		return nullptr;
+
+	const std::size_t n = header.bodyCount;
+	const auto* positions = ReadSection<Vec2>(file, header, SECTION_POSITIONS, n);
+	const auto* velocities = ReadSection<Vec2>(file, header, SECTION_VELOCITIES, n);
+	const auto* accelerations = ReadSection<Vec2>(file, header, SECTION_ACCELERATIONS, n);
+	const auto* sumForces = ReadSection<Vec2>(file, header, SECTION_SUM_FORCES, n);
+	const auto* rotations = ReadSection<float>(file, header, SECTION_ROTATIONS, n);
+	const auto* angularVelocities = ReadSection<float>(file, header, SECTION_ANGULAR_VELOCITIES, n);
+	const auto* angularAccelerations = ReadSection<float>(file, header, SECTION_ANGULAR_ACCELERATIONS, n);
+	const auto* sumTorques = ReadSection<float>(file, header, SECTION_SUM_TORQUES, n);
+	const auto* masses = ReadSection<float>(file, header, SECTION_MASSES, n);
+	const auto* invMasses = ReadSection<float>(file, header, SECTION_INV_MASSES, n);
+	const auto* inertias = ReadSection<float>(file, header, SECTION_INERTIAS, n);
+	const auto* invInertias = ReadSection<float>(file, header, SECTION_INV_INERTIAS, n);
+	const auto* restitutions = ReadSection<float>(file, header, SECTION_RESTITUTIONS, n);
+	const auto* frictions = ReadSection<float>(file, header, SECTION_FRICTIONS, n);
+	const auto* bullets = ReadSection<uint8_t>(file, header, SECTION_BULLETS, n);
+	const auto* sensors = ReadSection<uint8_t>(file, header, SECTION_SENSORS, n);
+	const auto* filters = ReadSection<CollisionFilter>(file, header, SECTION_FILTERS, n);
+	const auto* shapes = ReadSection<SnapshotShape>(file, header, SECTION_SHAPES, n);
+	const auto* vertices = ReadSection<Vec2>(file, header, SECTION_VERTICES, header.vertexCount);
+	const auto* joints = ReadSection<SnapshotJoint>(file, header, SECTION_JOINTS, header.jointCount);
+	const auto* satCacheRecords = ReadSection<SnapshotSatCache>(file, header, SECTION_SAT_CACHE, header.satCacheCount);
+	const auto* contactImpulseRecords = ReadSection<SnapshotContactImpulse>(file, header, SECTION_CONTACT_IMPULSES, header.contactImpulseCount);
+	const auto* touchingRecords = ReadSection<SnapshotContact>(file, header, SECTION_TOUCHING, header.touchingCount);
+	const auto* sensorOverlapRecords = ReadSection<SnapshotSensorOverlap>(file, header, SECTION_SENSOR_OVERLAPS, header.sensorOverlapCount);
+	const auto* forces = ReadSection<Vec2>(file, header, SECTION_FORCES, header.forceCount);
+	const auto* torques = ReadSection<float>(file, header, SECTION_TORQUES, header.torqueCount);
+	const auto* textureOffsets = ReadSection<uint32_t>(file, header, SECTION_TEXTURE_OFFSETS, n + 1);
+	const auto* textureChars = ReadSection<char>(file, header, SECTION_TEXTURE_CHARS, header.textureChars);
+
+	const void* sections[] = {
+		positions, velocities, accelerations, sumForces, rotations, angularVelocities, angularAccelerations, sumTorques, masses, invMasses,
+		inertias, invInertias, restitutions, frictions, bullets, sensors, filters, shapes, vertices, joints, satCacheRecords, contactImpulseRecords, touchingRecords, sensorOverlapRecords, forces, torques, textureOffsets, textureChars
+	};
+	for (const auto section : sections)
+	{
+		if (section == nullptr)
+			return nullptr;
+	}
+
+	if (header.solver > SOLVER_SOFT_STEP || header.positionCorrection > CORRECTION_SPLIT_IMPULSE || header.solverOrder > ORDER_COLORED)
+		return nullptr;
+
+	auto world = std::make_unique<World>(header.gravity);
+	world->SetSolver(static_cast<SolverType>(header.solver));
+	world->SetPositionCorrection(static_cast<PositionCorrection>(header.positionCorrection));
+	world->SetSolverOrder(static_cast<SolverOrder>(header.solverOrder));
+	world->SetSubsteps(header.substeps);
+	world->SetIterations(header.iterations);
+	world->SetPositionIterations(header.positionIterations);
+	world->SetTolerance(header.tolerance);
+	world->SetLodTick(header.lodTick);
+
+	for (uint32_t i = 0; i < header.forceCount; i++)
+		world->AddForce(forces[i]);
+
+	for (uint32_t i = 0; i < header.torqueCount; i++)
+		world->AddTorque(torques[i]);
+
+	for (std::size_t i = 0; i < n; i++)
+	{
+		std::unique_ptr<Shape> shape = CreateShape(shapes[i], vertices, header.vertexCount);
+		if (shape == nullptr || textureOffsets[i] > textureOffsets[i + 1] || textureOffsets[i + 1] > header.textureChars)
+			return nullptr;
+
+		void* memory = bodyArena.Allocate(sizeof(RigidBody), alignof(RigidBody));
+		if (memory == nullptr)
+			return nullptr;
+
+		// The constructor places the shape vertices and bounding radius from the stored transform
+		auto* body = new(memory) RigidBody(std::move(shape), positions[i], rotations[i], masses[i]);
+		body->m_invMass = invMasses[i];
+		body->m_inertia = inertias[i];
+		body->m_invInertia = invInertias[i];
+		body->m_restitution = restitutions[i];
+		body->m_friction = frictions[i];
+		body->m_isBullet = bullets[i] != 0;
+		body->m_isSensor = sensors[i] != 0;
+		body->m_filter = filters[i];
+		body->m_velocity = velocities[i];
+		body->m_acceleration = accelerations[i];
+		body->m_sumForces = sumForces[i];
+		body->m_angularVelocity = angularVelocities[i];
+		body->m_angularAcceleration = angularAccelerations[i];
+		body->m_sumTorque = sumTorques[i];
+		body->m_textureId.assign(textureChars + textureOffsets[i], textureOffsets[i + 1] - textureOffsets[i]);
+
+		world->AddBody(body);
+	}
+
+	const auto& bodies = world->GetBodies();
+	for (uint32_t i = 0; i < header.jointCount; i++)
+	{
+		const SnapshotJoint& record = joints[i];
+		if (record.a >= n || record.b >= n)
+			return nullptr;
+
+		void* memory = constraintArena.Allocate(sizeof(JointConstraint), alignof(JointConstraint));
+		if (memory == nullptr)
+			return nullptr;
+
+		auto* joint = new(memory) JointConstraint(bodies[record.a], bodies[record.b], Vec2(record.aPoint[0], record.aPoint[1]), Vec2(record.bPoint[0], record.bPoint[1]));
+		joint->SetCachedLambda(0, record.cachedLambda);
+		joint->collideConnected = record.collideConnected != 0;
+
+		world->AddConstraint(joint);
+	}
+
+	std::vector<SatCacheRecord> satCache;
+	satCache.reserve(header.satCacheCount);
+	for (uint32_t i = 0; i < header.satCacheCount; i++)
+	{
+		const SnapshotSatCache& record = satCacheRecords[i];
+		if (record.a >= n || record.b >= n)
+			return nullptr;
+
+		satCache.push_back({bodies[record.a], bodies[record.b], record.cache});
+	}
+
+	world->SetSatCache(satCache);
+
+	std::vector<ContactImpulseRecord> contactImpulses;
+	contactImpulses.reserve(header.contactImpulseCount);
+	for (uint32_t i = 0; i < header.contactImpulseCount; i++)
+	{
+		const SnapshotContactImpulse& record = contactImpulseRecords[i];
+		if (record.a >= n || record.b >= n)
+			return nullptr;
+
+		contactImpulses.push_back({bodies[record.a], bodies[record.b], record.offset, record.normalImpulse});
+	}
+
+	world->SetContactImpulses(contactImpulses);
+
+	std::vector<ContactEvent> touching;
+	touching.reserve(header.touchingCount);
+	for (uint32_t i = 0; i < header.touchingCount; i++)
+	{
+		const SnapshotContact& record = touchingRecords[i];
+		if (record.a >= n || record.b >= n)
+			return nullptr;
+
+		touching.push_back({bodies[record.a], bodies[record.b], record.point, record.normal, record.maxNormalImpulse});
+	}
+
+	world->SetTouching(touching);
+
+	std::vector<SensorEvent> sensorOverlaps;
+	sensorOverlaps.reserve(header.sensorOverlapCount);
+	for (uint32_t i = 0; i < header.sensorOverlapCount; i++)
+	{
+		const SnapshotSensorOverlap& record = sensorOverlapRecords[i];
+		if (record.sensor >= n || record.visitor >= n)
+			return nullptr;
+
+		sensorOverlaps.push_back({bodies[record.sensor], bodies[record.visitor]});
+	}
+
+	world->SetSensorOverlaps(sensorOverlaps);
+	return world;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "SatCache.h"
+
+class Arena;
+class World;
+
+// Versioned binary image of a World.
+// The file is a fixed header followed by 16-byte aligned sections, located through the header's offset table.
+// Body data is stored as one array per field so a mapped file can be read in place without parsing.
+// All values are stored in native (little endian) byte order.
+enum SnapshotSection : uint32_t
+{
+	SECTION_POSITIONS,
+	SECTION_VELOCITIES,
+	SECTION_ACCELERATIONS,
+	SECTION_SUM_FORCES,
+	SECTION_ROTATIONS,
+	SECTION_ANGULAR_VELOCITIES,
+	SECTION_ANGULAR_ACCELERATIONS,
+	SECTION_SUM_TORQUES,
+	SECTION_MASSES,
+	SECTION_INV_MASSES,
+	SECTION_INERTIAS,
+	SECTION_INV_INERTIAS,
+	SECTION_RESTITUTIONS,
+	SECTION_FRICTIONS,
+	SECTION_SHAPES,
+	SECTION_VERTICES,
+	SECTION_JOINTS,
+	SECTION_FORCES,
+	SECTION_TORQUES,
+	SECTION_TEXTURE_OFFSETS,
+	SECTION_TEXTURE_CHARS,
+	SECTION_BULLETS,
+	SECTION_FILTERS,
+	SECTION_SAT_CACHE,
+	SECTION_SENSORS,
+	SECTION_TOUCHING,
+	SECTION_SENSOR_OVERLAPS,
+	SECTION_CONTACT_IMPULSES,
+	SECTION_COUNT
+};
+
+struct SnapshotHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fileSize;
+
+	float gravity;
+
+	// Solver settings and level of detail tick, a world loaded with other ones steps differently from the one saved
+	uint8_t solver;
+	uint8_t positionCorrection;
+	uint8_t solverOrder;
+	int32_t substeps;
+	int32_t iterations;
+	int32_t positionIterations;
+	float tolerance;
+	uint64_t lodTick;
+
+	uint32_t bodyCount;
+	uint32_t jointCount;
+	uint32_t vertexCount;
+	uint32_t forceCount;
+	uint32_t torqueCount;
+	uint32_t textureChars;
+	uint32_t satCacheCount;
+	uint32_t touchingCount;
+	uint32_t sensorOverlapCount;
+	uint32_t contactImpulseCount;
+
+	uint64_t sectionOffsets[SECTION_COUNT];
+};
+
+struct SnapshotShape
+{
+	uint32_t type;
+	float radius; // Circle and capsule only
+	int32_t width; // Box only
+	int32_t height; // Box only
+	uint32_t firstVertex; // Polygon only, index in the vertices section
+	uint32_t vertexCount; // Polygon only
+	float halfLength; // Capsule and segment only
+};
+
+struct SnapshotJoint
+{
+	uint32_t a; // Body indices
+	uint32_t b;
+	float aPoint[2];
+	float bPoint[2];
+	float cachedLambda;
+	uint32_t collideConnected;
+};
+
+struct SnapshotSatCache
+{
+	uint32_t a; // Body indices
+	uint32_t b;
+	SatCache cache;
+};
+
+struct SnapshotContactImpulse
+{
+	uint32_t a; // Body indices
+	uint32_t b;
+	Vec2 offset;
+	float normalImpulse;
+};
+
+struct SnapshotContact
+{
+	uint32_t a; // Body indices
+	uint32_t b;
+	Vec2 point;
+	Vec2 normal;
+	float maxNormalImpulse;
+};
+
+struct SnapshotSensorOverlap
+{
+	uint32_t sensor; // Body indices
+	uint32_t visitor;
+};
+
+class Snapshot
+{
+public:
+	static constexpr uint32_t MAGIC = 0x53443250; // "P2DS"
+	static constexpr uint32_t VERSION = 10;
+
+	static bool Save(const World& world, const std::string& path);
+
+	// Bodies and joints are placed in the given arenas, the world only references them like with AddBody/AddConstraint.
+	// Returns nullptr if the file is missing, invalid or does not fit in the arenas.
+	static std::unique_ptr<World> Load(const std::string& path, Arena& bodyArena, Arena& constraintArena);
+};
@@ -0,0 +1,132 @@
+#include "StaticTree.h"
+#include "RigidBody.h"
+#include "Shape.h"
+
+#include <algorithm>
+
+namespace
+{
+	constexpr uint32_t LEAF_SIZE = 2;
+	constexpr int MAX_DEPTH = 64;
+}
+
+void StaticTree::Build(const std::vector<RigidBody*>& bodies)
+{
+	Clear();
+	if (bodies.empty())
+		return;
+
+	m_proxies.reserve(bodies.size());
+	for (const auto body : bodies)
+		m_proxies.push_back({body->m_shape->m_box, body});
+
+	m_nodes.reserve(2 * bodies.size());
+	BuildNode(0, static_cast<uint32_t>(m_proxies.size()));
+}
+
+void StaticTree::Clear()
+{
+	m_nodes.clear();
+	m_proxies.clear();
+}
+
+int32_t StaticTree::BuildNode(const uint32_t first, const uint32_t count)
+{
+	const auto index = static_cast<int32_t>(m_nodes.size());
+	m_nodes.emplace_back();
+
+	AABB box = m_proxies[first].box;
+	for (uint32_t i = first + 1; i < first + count; i++)
+		box = box.Union(m_proxies[i].box);
+
+	m_nodes[index].box = box;
+	if (count <= LEAF_SIZE)
+	{
+		m_nodes[index].first = first;
+		m_nodes[index].count = count;
+		return index;
+	}
+
+	// Split on the median of the box centers along the longest axis
+	const bool splitX = box.max.x - box.min.x >= box.max.y - box.min.y;
+	const auto begin = m_proxies.begin() + first;
+	const auto middle = begin + count / 2;
+	std::nth_element(begin, middle, begin + count, [splitX](const Proxy& lhs, const Proxy& rhs)
+	{
+		return splitX ? lhs.box.Center().x < rhs.box.Center().x : lhs.box.Center().y < rhs.box.Center().y;
+	});
+
+	// Children are built before writing them, the vector may grow in between
+	const int32_t left = BuildNode(first, count / 2);
+	const int32_t right = BuildNode(first + count / 2, count - count / 2);
+	m_nodes[index].left = left;
+	m_nodes[index].right = right;
+
+	return index;
+}
+
+void StaticTree::Query(const AABB& box, std::vector<RigidBody*>& outBodies) const
+{
+	if (m_nodes.empty())
+		return;
+
+	// The tree is balanced, its depth stays far below the stack size
+	int32_t stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+		if (node.box.Overlaps(box) == false)
+			continue;
+
+		if (node.left < 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				if (m_proxies[i].box.Overlaps(box))
+					outBodies.push_back(m_proxies[i].body);
+			}
+			continue;
+		}
+
+		stack[stackSize++] = node.left;
+		stack[stackSize++] = node.right;
+	}
+}
+
+void StaticTree::RayCast(const Vec2& start, const Vec2& end, std::vector<RigidBody*>& outBodies) const
+{
+	if (m_nodes.empty())
+		return;
+
+	int32_t stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+		if (node.box.IntersectsSegment(start, end) == false)
+			continue;
+
+		if (node.left < 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				if (m_proxies[i].box.IntersectsSegment(start, end))
+					outBodies.push_back(m_proxies[i].body);
+			}
+			continue;
+		}
+
+		stack[stackSize++] = node.left;
+		stack[stackSize++] = node.right;
+	}
+}
+
+std::size_t StaticTree::Size() const
+{
+	return m_proxies.size();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AABB.h"
+
+class RigidBody;
+
+// Bounding volume hierarchy over the static bodies.
+// Static bodies never move, so the tree is built once (top down, splitting on the median of the longest axis) and only
+// queried afterwards. It has to be built again when static bodies are added.
+class StaticTree
+{
+public:
+	void Build(const std::vector<RigidBody*>& bodies);
+	void Clear();
+
+	// Appends the bodies whose box overlaps the given box
+	void Query(const AABB& box, std::vector<RigidBody*>& outBodies) const;
+	// Appends the bodies whose box the segment from start to end goes through
+	void RayCast(const Vec2& start, const Vec2& end, std::vector<RigidBody*>& outBodies) const;
+
+	[[nodiscard]] std::size_t Size() const;
+
+private:
+	struct Node
+	{
+		AABB box;
+		int32_t left = -1; // Children node indices, -1 for a leaf
+		int32_t right = -1;
+		uint32_t first = 0; // Leaf range in m_proxies
+		uint32_t count = 0;
+	};
+
+	struct Proxy
+	{
+		AABB box;
+		RigidBody* body;
+	};
+
+	int32_t BuildNode(uint32_t first, uint32_t count);
+
+	std::vector<Node> m_nodes;
+	std::vector<Proxy> m_proxies;
+};
@@ -0,0 +1,94 @@
+#include "physics/StepGovernor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr int MIN_ITERATIONS = 2; // Below this the contacts of a stack stop holding
+	constexpr float RECOVERY_MARGIN = 0.8f; // Share of the budget a step one level up has to fit in
+	constexpr int RECOVERY_STEPS = 30; // Steps in a row under the margin before going back up a level
+}
+
+StepGovernor::StepGovernor(World& world, const float budget) : m_world(world), m_budget(budget)
+{
+	m_baseIterations = world.GetIterations();
+	m_basePositionIterations = world.GetPositionIterations();
+	m_baseSubsteps = world.GetSubsteps();
+
+	// The last level is the first one where every setting is at its minimum
+	while ((m_baseIterations >> m_maxLevel) > MIN_ITERATIONS || (m_basePositionIterations >> m_maxLevel) > 1 || (m_baseSubsteps >> m_maxLevel) > 1)
+		m_maxLevel++;
+
+	ApplyLevel();
+}
+
+void StepGovernor::Step(const float dt)
+{
+	m_world.Update(dt);
+
+	const StepStats& stats = m_world.GetStepStats();
+	if (m_report.level > 0)
+		m_report.degradedSteps++;
+
+	if (stats.stepTime > m_budget)
+	{
+		m_report.overBudgetSteps++;
+		m_calmSteps = 0;
+
+		// Only the solver gets cheaper, it has to fit in what the rest of the step left. A step spent in the collisions
+		// goes straight to the last level.
+		const float solveBudget = m_budget - (stats.stepTime - stats.solveTime);
+		int halvings = m_maxLevel;
+		if (solveBudget > 0.0f)
+			halvings = static_cast<int>(std::ceil(std::log2(std::max(1.0f, stats.solveTime / solveBudget))));
+
+		const int level = std::min(m_maxLevel, m_report.level + std::max(1, halvings));
+		if (level != m_report.level)
+		{
+			m_report.level = level;
+			ApplyLevel();
+		}
+
+		return;
+	}
+
+	if (m_report.level == 0)
+		return;
+
+	// One level up about doubles the solve time
+	m_calmSteps = stats.stepTime + stats.solveTime <= m_budget * RECOVERY_MARGIN ? m_calmSteps + 1 : 0;
+	if (m_calmSteps >= RECOVERY_STEPS)
+	{
+		m_calmSteps = 0;
+		m_report.level--;
+		ApplyLevel();
+	}
+}
+
+void StepGovernor::SetBudget(const float budget)
+{
+	m_budget = budget;
+}
+
+float StepGovernor::GetBudget() const
+{
+	return m_budget;
+}
+
+const GovernorReport& StepGovernor::GetReport() const
+{
+	return m_report;
+}
+
+void StepGovernor::ApplyLevel()
+{
+	const int level = m_report.level;
+	m_report.iterations = std::max(std::min(MIN_ITERATIONS, m_baseIterations), m_baseIterations >> level);
+	m_report.positionIterations = std::max(1, m_basePositionIterations >> level);
+	m_report.substeps = std::max(1, m_baseSubsteps >> level);
+
+	m_world.SetIterations(m_report.iterations);
+	m_world.SetPositionIterations(m_report.positionIterations);
+	m_world.SetSubsteps(m_report.substeps);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "World.h"
+
+// What the governor lowered to keep the steps in their budget
+struct GovernorReport
+{
+	int level = 0; // 0 runs the settings the world had, every level halves the solver work again
+	int iterations = 0; // Solver settings of the level
+	int positionIterations = 0;
+	int substeps = 0;
+	uint64_t overBudgetSteps = 0; // Steps that took longer than the budget
+	uint64_t degradedSteps = 0; // Steps run above level 0
+};
+
+// Keeps the step time of a world under a budget by trading solver accuracy for time.
+// A step over the budget lowers the solver iterations, the split impulse iterations and the soft step substeps by as many
+// halvings as its solve time needs to fit in what the collisions left of the budget. Once the steps would fit again with
+// twice the solve time for a while, the governor goes back up one level at a time.
+class StepGovernor
+{
+public:
+	// The settings of the world when the governor is made are level 0, the budget is in microseconds
+	StepGovernor(World& world, float budget);
+
+	// Steps the world, then sets the level of the next steps from the time this one took
+	void Step(float dt);
+
+	void SetBudget(float budget);
+	[[nodiscard]] float GetBudget() const;
+	[[nodiscard]] const GovernorReport& GetReport() const;
+
+private:
+	void ApplyLevel();
+
+	World& m_world;
+	float m_budget;
+	int m_baseIterations;
+	int m_basePositionIterations;
+	int m_baseSubsteps;
+	int m_maxLevel = 0;
+	int m_calmSteps = 0; // Steps in a row that would fit in the budget one level up
+	GovernorReport m_report;
+};
@@ -3,15 +3,70 @@
 #include "physics/CollisionDetection.h"
 #include "physics/Constants.h"
 #include "physics/RigidBody.h"
+#include "jobs/JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr float TIME_OF_IMPACT_TARGET = 1.0f; // Distance in pixels at which a bullet is stopped, left for the contacts to solve
+	constexpr float CONTACT_MATCH_DISTANCE = 2.0f; // Distance in pixels within which a contact takes the impulses of one of the last step
+
+	// Smallest ranges handed to the job system, a job costs about a microsecond to queue and steal
+	constexpr std::size_t MIN_BODIES_PER_JOB = 256; // Integration, a few tens of nanoseconds per body
+	constexpr std::size_t MIN_BROAD_PHASE_BODIES_PER_JOB = 16; // Each body goes through the next ones and the static tree
+	constexpr std::size_t MIN_PAIRS_PER_JOB = 32; // Narrow phase, a few hundred nanoseconds per pair
+	constexpr std::size_t MIN_CIRCLE_PAIRS_PER_JOB = 512; // Batched circle pairs, a multiple of the 4 pairs of a batch
+	constexpr std::size_t MIN_CONSTRAINTS_PER_JOB = 64; // Constraints of a color, about a hundred nanoseconds per pass
+	constexpr std::size_t MIN_RAYS_PER_JOB = 16; // Ray casts, about a microsecond each
+
+	// Joined pairs are stored in address order, so both orders of a pair find them
+	std::pair<const RigidBody*, const RigidBody*> OrderedPair(const RigidBody* a, const RigidBody* b)
+	{
+		return std::less<const RigidBody*>()(a, b) ? std::make_pair(a, b) : std::make_pair(b, a);
+	}
+
+	float Microseconds(const Clock::time_point from, const Clock::time_point to)
+	{
+		return std::chrono::duration<float, std::micro>(to - from).count();
+	}
+}
 
 World::World(const float gravity)
 {
 	m_gravity = -gravity;
 }
 
+World::~World() = default;
+
+float World::GetGravity() const
+{
+	return -m_gravity;
+}
+
 void World::AddBody(RigidBody* body)
 {
 	m_bodies.push_back(body);
+	m_bodySet.insert(body);
+
+	if (body->IsStatic())
+	{
+		m_staticBodies.push_back(body);
+		m_isStaticTreeDirty = true;
+	}
+	else
+	{
+		m_dynamicBodies.push_back(body);
+	}
 }
 
 std::vector<RigidBody*>& World::GetBodies()
@@ -19,9 +74,187 @@ std::vector<RigidBody*>& World::GetBodies()
 	return m_bodies;
 }
 
+const std::vector<RigidBody*>& World::GetBodies() const
+{
+	return m_bodies;
+}
+
+const std::vector<RigidBody*>& World::GetStaticBodies() const
+{
+	return m_staticBodies;
+}
+
+const std::vector<RigidBody*>& World::GetDynamicBodies() const
+{
+	return m_dynamicBodies;
+}
+
 void World::AddConstraint(JointConstraint* constraint)
 {
 	m_constraints.push_back(constraint);
+	m_constraintSet.insert(constraint);
+
+	if (constraint->collideConnected == false)
+		m_jointPairs.insert(OrderedPair(constraint->a, constraint->b));
+}
+
+void World::QueueAddBody(RigidBody* body)
+{
+	std::lock_guard<std::mutex> lock(m_commandMutex);
+	m_commands.push_back({COMMAND_ADD_BODY, body, nullptr, Vec2(), 0.0f});
+}
+
+void World::QueueRemoveBody(RigidBody* body)
+{
+	std::lock_guard<std::mutex> lock(m_commandMutex);
+	m_commands.push_back({COMMAND_REMOVE_BODY, body, nullptr, Vec2(), 0.0f});
+}
+
+void World::QueueSetVelocity(RigidBody* body, const Vec2& velocity, const float angularVelocity)
+{
+	std::lock_guard<std::mutex> lock(m_commandMutex);
+	m_commands.push_back({COMMAND_SET_VELOCITY, body, nullptr, velocity, angularVelocity});
+}
+
+void World::QueueAddConstraint(JointConstraint* constraint)
+{
+	std::lock_guard<std::mutex> lock(m_commandMutex);
+	m_commands.push_back({COMMAND_ADD_CONSTRAINT, nullptr, constraint, Vec2(), 0.0f});
+}
+
+void World::QueueRemoveConstraint(JointConstraint* constraint)
+{
+	std::lock_guard<std::mutex> lock(m_commandMutex);
+	m_commands.push_back({COMMAND_REMOVE_CONSTRAINT, nullptr, constraint, Vec2(), 0.0f});
+}
+
+void World::FlushCommands()
+{
+	// Take the whole queue at once, commands queued while it is applied wait for the next flush
+	{
+		std::lock_guard<std::mutex> lock(m_commandMutex);
+		if (m_commands.empty())
+			return;
+
+		m_flushedCommands.swap(m_commands);
+	}
+
+	std::size_t addedBodies = 0;
+	for (const auto& command : m_flushedCommands)
+		addedBodies += command.type == COMMAND_ADD_BODY ? 1 : 0;
+
+	m_bodies.reserve(m_bodies.size() + addedBodies);
+	m_dynamicBodies.reserve(m_dynamicBodies.size() + addedBodies);
+	m_bodySet.reserve(m_bodySet.size() + addedBodies);
+
+	// Removals wait for the end of the flush, a body added back after its removal is kept where it was. Adding a body or
+	// joint the world holds does nothing, and so does removing one it does not hold.
+	std::unordered_set<const RigidBody*> removedBodies;
+	std::unordered_set<const JointConstraint*> removedConstraints;
+	for (const auto& command : m_flushedCommands)
+	{
+		switch (command.type)
+		{
+		case COMMAND_ADD_BODY:
+			if (removedBodies.erase(command.body) == 0 && m_bodySet.count(command.body) == 0)
+				AddBody(command.body);
+			break;
+		case COMMAND_REMOVE_BODY:
+			if (m_bodySet.count(command.body) > 0)
+				removedBodies.insert(command.body);
+			break;
+		case COMMAND_SET_VELOCITY:
+			// The body may be gone already, only a body the world holds is written
+			if (m_bodySet.count(command.body) > 0 && removedBodies.count(command.body) == 0)
+			{
+				command.body->m_velocity = command.velocity;
+				command.body->m_angularVelocity = command.angularVelocity;
+			}
+			break;
+		case COMMAND_ADD_CONSTRAINT:
+			if (removedConstraints.erase(command.constraint) == 0 && m_constraintSet.count(command.constraint) == 0)
+				AddConstraint(command.constraint);
+			break;
+		case COMMAND_REMOVE_CONSTRAINT:
+			if (m_constraintSet.count(command.constraint) > 0)
+				removedConstraints.insert(command.constraint);
+			break;
+		}
+	}
+
+	m_flushedCommands.clear();
+	if (removedBodies.empty() && removedConstraints.empty())
+		return;
+
+	const auto isRemoved = [&removedBodies](const RigidBody* body) { return removedBodies.count(body) > 0; };
+	const auto eraseBodies = [&isRemoved](std::vector<RigidBody*>& bodies)
+	{
+		const std::size_t count = bodies.size();
+		bodies.erase(std::remove_if(bodies.begin(), bodies.end(), isRemoved), bodies.end());
+		return bodies.size() != count;
+	};
+
+	for (const auto body : removedBodies)
+		m_bodySet.erase(body);
+
+	eraseBodies(m_bodies);
+	eraseBodies(m_dynamicBodies);
+	if (eraseBodies(m_staticBodies))
+		m_isStaticTreeDirty = true;
+
+	// The joints of the removed bodies go with them, the pairs they kept apart are found again from the ones left
+	m_constraints.erase(std::remove_if(m_constraints.begin(), m_constraints.end(), [&](const JointConstraint* constraint)
+	{
+		const bool isConstraintRemoved = removedConstraints.count(constraint) > 0 || isRemoved(constraint->a) || isRemoved(constraint->b);
+		if (isConstraintRemoved)
+			m_constraintSet.erase(constraint);
+
+		return isConstraintRemoved;
+	}), m_constraints.end());
+
+	m_jointPairs.clear();
+	for (const auto constraint : m_constraints)
+	{
+		if (constraint->collideConnected == false)
+			m_jointPairs.insert(OrderedPair(constraint->a, constraint->b));
+	}
+
+	if (removedBodies.empty())
+		return;
+
+	for (auto it = m_satCache.begin(); it != m_satCache.end();)
+	{
+		if (isRemoved(it->first.first) || isRemoved(it->first.second))
+			it = m_satCache.erase(it);
+		else
+			++it;
+	}
+
+	for (auto it = m_contactImpulses.begin(); it != m_contactImpulses.end();)
+	{
+		if (isRemoved(it->first.first) || isRemoved(it->first.second))
+			it = m_contactImpulses.erase(it);
+		else
+			++it;
+	}
+
+	m_touching.erase(std::remove_if(m_touching.begin(), m_touching.end(), [&isRemoved](const ContactEvent& event)
+	{
+		return isRemoved(event.a) || isRemoved(event.b);
+	}), m_touching.end());
+
+	m_touchingPairs.clear();
+	for (const auto& event : m_touching)
+		m_touchingPairs.insert(OrderedPair(event.a, event.b));
+
+	m_sensorOverlaps.erase(std::remove_if(m_sensorOverlaps.begin(), m_sensorOverlaps.end(), [&isRemoved](const SensorEvent& pair)
+	{
+		return isRemoved(pair.sensor) || isRemoved(pair.visitor);
+	}), m_sensorOverlaps.end());
+
+	m_sensorOverlapPairs.clear();
+	for (const auto& pair : m_sensorOverlaps)
+		m_sensorOverlapPairs.insert({pair.sensor, pair.visitor});
 }
 
 std::vector<JointConstraint*>& World::GetConstraints()
@@ -29,6 +262,11 @@ std::vector<JointConstraint*>& World::GetConstraints()
 	return m_constraints;
 }
 
+const std::vector<JointConstraint*>& World::GetConstraints() const
+{
+	return m_constraints;
+}
+
 void World::AddForce(const Vec2& force)
 {
 	m_forces.emplace_back(force.x, force.y);
@@ -39,73 +277,1426 @@ void World::AddTorque(const float torque)
 	m_torques.emplace_back(torque);
 }
 
-void World::Update(const float dt) const
+const std::vector<Vec2>& World::GetForces() const
 {
-	// Create a vector of penetration constraints that will be solved frame per frame
-	std::vector<PenetrationConstraint> penetrations;
+	return m_forces;
+}
+
+const std::vector<float>& World::GetTorques() const
+{
+	return m_torques;
+}
+
+void World::SetSolver(const SolverType solver)
+{
+	m_solver = solver;
+}
+
+SolverType World::GetSolver() const
+{
+	return m_solver;
+}
+
+void World::SetSubsteps(const int substeps)
+{
+	m_substeps = std::max(1, substeps);
+}
+
+int World::GetSubsteps() const
+{
+	return m_substeps;
+}
+
+void World::SetIterations(const int maxIterations)
+{
+	m_maxIterations = std::max(1, maxIterations);
+}
+
+int World::GetIterations() const
+{
+	return m_maxIterations;
+}
+
+void World::SetTolerance(const float tolerance)
+{
+	m_tolerance = std::max(0.0f, tolerance);
+}
+
+float World::GetTolerance() const
+{
+	return m_tolerance;
+}
+
+const StepStats& World::GetStepStats() const
+{
+	return m_stepStats;
+}
+
+void World::GetSatCache(std::vector<SatCacheRecord>& outRecords) const
+{
+	outRecords.clear();
+	outRecords.reserve(m_satCache.size());
+	for (const auto& [pair, entry] : m_satCache)
+		outRecords.push_back({pair.first, pair.second, entry.cache});
+}
+
+void World::SetSatCache(const std::vector<SatCacheRecord>& records)
+{
+	m_satCache.clear();
+	for (const auto& record : records)
+		m_satCache[{record.a, record.b}].cache = record.cache;
+}
+
+const std::vector<ContactEvent>& World::GetTouching() const
+{
+	return m_touching;
+}
+
+void World::SetTouching(const std::vector<ContactEvent>& touching)
+{
+	m_touching = touching;
+	m_touchingPairs.clear();
+	for (const auto& event : m_touching)
+		m_touchingPairs.insert(OrderedPair(event.a, event.b));
+}
 
-	for (const auto body : m_bodies)
+const std::vector<SensorEvent>& World::GetSensorOverlaps() const
+{
+	return m_sensorOverlaps;
+}
+
+void World::SetSensorOverlaps(const std::vector<SensorEvent>& overlaps)
+{
+	m_sensorOverlaps = overlaps;
+	m_sensorOverlapPairs.clear();
+	for (const auto& pair : m_sensorOverlaps)
+		m_sensorOverlapPairs.insert({pair.sensor, pair.visitor});
+}
+
+void World::GetContactImpulses(std::vector<ContactImpulseRecord>& outRecords) const
+{
+	outRecords.clear();
+	for (const auto& [pair, entry] : m_contactImpulses)
 	{
-		const Vec2 weight = Vec2(0.0f, m_gravity * PIXELS_PER_METER * body->m_mass);
-		body->AddForce(weight);
+		for (int i = 0; i < entry.count; i++)
+			outRecords.push_back({pair.first, pair.second, entry.offsets[i], entry.normalImpulses[i]});
+	}
+}
 
-		for (const auto& force : m_forces)
-			body->AddForce(force);
+void World::SetContactImpulses(const std::vector<ContactImpulseRecord>& records)
+{
+	m_contactImpulses.clear();
+	for (const auto& record : records)
+	{
+		ContactImpulseEntry& entry = m_contactImpulses[{record.a, record.b}];
+		if (entry.count == MAX_CACHED_CONTACTS)
+			continue;
 
-		for (const auto torque : m_torques)
-			body->AddTorque(torque);
+		entry.offsets[entry.count] = record.offset;
+		entry.normalImpulses[entry.count] = record.normalImpulse;
+		entry.count++;
 	}
+}
 
-	// Integrate all the forces
-	for (const auto& body : m_bodies)
-		body->IntegrateForces(dt);
+void World::SetPositionCorrection(const PositionCorrection correction)
+{
+	m_positionCorrection = correction;
+}
+
+PositionCorrection World::GetPositionCorrection() const
+{
+	return m_positionCorrection;
+}
+
+void World::SetPositionIterations(const int positionIterations)
+{
+	m_positionIterations = std::max(1, positionIterations);
+}
+
+int World::GetPositionIterations() const
+{
+	return m_positionIterations;
+}
 
-	// Update bounding circles for broad phase
-	for (const auto& body : m_bodies)
-		body->UpdateBoundingRadius();
+void World::SetJobSystem(JobSystem* jobSystem)
+{
+	m_jobSystem = jobSystem;
+}
+
+JobSystem* World::GetJobSystem() const
+{
+	return m_jobSystem;
+}
+
+void World::SetSolverOrder(const SolverOrder order)
+{
+	m_solverOrder = order;
+}
 
-	// Check all the rigid bodies with the other rigid bodies for collision
-	for (std::size_t i = 0; i < m_bodies.size() - 1; i++)
+SolverOrder World::GetSolverOrder() const
+{
+	return m_solverOrder;
+}
+
+uint64_t World::ComputeStateHash() const
+{
+	// FNV-1a on the bits of the state, two worlds with the same hash took the same steps
+	uint64_t hash = 14695981039346656037ULL;
+	const auto add = [&hash](const float value)
 	{
-		for (std::size_t j = i + 1; j < m_bodies.size(); j++)
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		for (int i = 0; i < 4; i++)
 		{
-			// Broad phase check first
-			if (BroadPhaseCollisionCheck(m_bodies[i]->m_position, m_bodies[i]->m_radius, m_bodies[j]->m_position, m_bodies[j]->m_radius) == false)
-				continue;
+			hash ^= (bits >> (i * 8)) & 0xFFU;
+			hash *= 1099511628211ULL;
+		}
+	};
 
-			// If broad phase passes, do narrow phase check
-			std::vector<Contact> contacts;
-			if (IsColliding(m_bodies[i], m_bodies[j], contacts))
-			{
-				for (const auto& contact : contacts) 
-					penetrations.emplace_back(contact.a, contact.b, contact.start, contact.end, contact.normal);
-			}
+	for (const auto body : m_dynamicBodies)
+	{
+		add(body->m_position.x);
+		add(body->m_position.y);
+		add(body->m_rotation);
+		add(body->m_velocity.x);
+		add(body->m_velocity.y);
+		add(body->m_angularVelocity);
+	}
+
+	return hash;
+}
+
+void World::SetFocusPoints(const std::vector<Vec2>& points)
+{
+	m_focusPoints = points;
+
+	// Back to every body on every tick
+	if (m_focusPoints.empty())
+	{
+		for (const auto body : m_dynamicBodies)
+		{
+			body->m_lodTier = 0;
+			body->m_stepTicks = 1;
+			body->m_ticksSinceStep = 0;
 		}
 	}
+}
 
-	// Solve all constraints
-	for (const auto constraint : m_constraints)
-		constraint->PreSolve(dt);
+const std::vector<Vec2>& World::GetFocusPoints() const
+{
+	return m_focusPoints;
+}
 
-	for (auto& constraint : penetrations)
-		constraint.PreSolve(dt);
+void World::SetLodDistances(const float nearDistance, const float farDistance)
+{
+	m_lodNearDistance = std::max(0.0f, nearDistance);
+	m_lodFarDistance = std::max(m_lodNearDistance, farDistance);
+}
+
+float World::GetLodNearDistance() const
+{
+	return m_lodNearDistance;
+}
+
+float World::GetLodFarDistance() const
+{
+	return m_lodFarDistance;
+}
+
+void World::SetLodTick(const uint64_t tick)
+{
+	m_lodTick = tick;
+}
+
+uint64_t World::GetLodTick() const
+{
+	return m_lodTick;
+}
+
+std::size_t World::GrainSize(const std::size_t count, const std::size_t minGrain) const
+{
+	// Without a job system everything is one range
+	if (m_jobSystem == nullptr)
+		return std::max<std::size_t>(count, 1);
+
+	return m_jobSystem->GrainSize(count, minGrain);
+}
 
-	for (int i = 0; i < 10; ++i)
+template <typename Body>
+void World::ParallelFor(const std::size_t count, const std::size_t grain, const Body& body) const
+{
+	if (m_jobSystem == nullptr)
 	{
-		for (const auto constraint : m_constraints)
-			constraint->Solve();
+		if (count > 0)
+			body(0, count);
 
-		for (auto& constraint : penetrations)
-			constraint.Solve();
+		return;
 	}
 
-	for (const auto constraint : m_constraints)
-		constraint->PostSolve();
+	m_jobSystem->ParallelFor(count, grain, body);
+}
 
-	for (auto& constraint : penetrations)
-		constraint.PostSolve();
+void World::Update(const float dt)
+{
+	// Create a vector of penetration constraints that will be solved frame per frame
+	std::vector<PenetrationConstraint> penetrations;
+	m_stepStats = StepStats();
+	const Clock::time_point start = Clock::now();
+
+	// Changes queued since the last step, before anything reads the bodies
+	FlushCommands();
+
+	m_steppedLodTiers = ~0U;
+	if (m_focusPoints.empty())
+		StepBodies(penetrations, dt, false);
+	else
+		StepLevelsOfDetail(penetrations, dt);
+
+	PruneSatCache();
+	PruneContactImpulses();
+	ReportContacts(penetrations);
+	ReportSensors();
+
+	m_stepStats.stepTime = Microseconds(start, Clock::now());
+}
+
+void World::StartStep(RigidBody* body, const float dt) const
+{
+	body->SavePreviousTransform();
+
+	const Vec2 weight = Vec2(0.0f, m_gravity * PIXELS_PER_METER * body->m_mass);
+	body->AddForce(weight);
+
+	for (const auto& force : m_forces)
+		body->AddForce(force);
+
+	for (const auto torque : m_torques)
+		body->AddTorque(torque);
+
+	// Integrate all the forces, the soft step integrates them in every substep
+	if (m_solver != SOLVER_SOFT_STEP)
+		body->IntegrateForces(dt);
+}
+
+void World::StepBodies(std::vector<PenetrationConstraint>& penetrations, const float dt, const bool hasPairs)
+{
+	// Static bodies never move and take no force, only the dynamic ones are stepped. The forces are integrated before
+	// the broad phase, so the speculative margins see the velocities of this step.
+	if (hasPairs == false)
+	{
+		ParallelFor(m_dynamicBodies.size(), GrainSize(m_dynamicBodies.size(), MIN_BODIES_PER_JOB), [this, dt](const std::size_t first, const std::size_t last)
+		{
+			for (std::size_t i = first; i < last; i++)
+				StartStep(m_dynamicBodies[i], dt);
+		});
+	}
+
+	const Clock::time_point detecting = Clock::now();
+	if (hasPairs == false)
+		FindAllPairs(dt);
+
+	NarrowPhase(penetrations);
+	const Clock::time_point detected = Clock::now();
+	m_stepStats.collisionTime += Microseconds(detecting, detected);
+
+	if (m_solver == SOLVER_SOFT_STEP)
+		SolveSoftStep(penetrations, dt);
+	else
+		SolveIterative(penetrations, dt);
+
+	m_stepStats.solveTime += Microseconds(detected, Clock::now());
+
+	SolveTimeOfImpact();
+}
+
+void World::StepLevelsOfDetail(std::vector<PenetrationConstraint>& penetrations, const float dt)
+{
+	// Tier of every body from its distance to the closest focus point, the broad phase widens the speculative margins of
+	// the far bullets with it
+	const float nearSquared = m_lodNearDistance * m_lodNearDistance;
+	const float farSquared = m_lodFarDistance * m_lodFarDistance;
+	m_lodDistanceTiers.resize(m_dynamicBodies.size());
+	for (std::size_t i = 0; i < m_dynamicBodies.size(); i++)
+	{
+		RigidBody* body = m_dynamicBodies[i];
+		float distanceSquared = std::numeric_limits<float>::max();
+		for (const auto& point : m_focusPoints)
+			distanceSquared = std::min(distanceSquared, (body->m_position - point).MagnitudeSquared());
+
+		body->m_lodTier = distanceSquared > farSquared ? 2 : distanceSquared > nearSquared ? 1 : 0;
+		body->m_lodIndex = i;
+		m_lodDistanceTiers[i] = body->m_lodTier;
+	}
+
+	// Time a tier steps over on this tick, none when it is not due
+	const auto tierStepTime = [this, dt](const int tier)
+	{
+		const uint64_t rate = 1ULL << tier;
+		return (m_lodTick + 1) % rate == 0 ? dt * static_cast<float>(rate) : 0.0f;
+	};
+
+	// The bodies due on this tick integrate their forces before the broad phase, as in StepBodies, over the step of
+	// the tier of their distance
+	ParallelFor(m_dynamicBodies.size(), GrainSize(m_dynamicBodies.size(), MIN_BODIES_PER_JOB), [this, &tierStepTime](const std::size_t first, const std::size_t last)
+	{
+		for (std::size_t i = first; i < last; i++)
+		{
+			const float stepTime = tierStepTime(m_dynamicBodies[i]->m_lodTier);
+			if (stepTime > 0.0f)
+				StartStep(m_dynamicBodies[i], stepTime);
+		}
+	});
+
+	// One broad phase for every tier, then each island takes the finest tier of its bodies
+	const Clock::time_point detecting = Clock::now();
+	FindAllPairs(dt);
+	m_stepStats.collisionTime += Microseconds(detecting, Clock::now());
+	BuildIslands();
 
-	// Integrate all the velocities
-	for (const auto body : m_bodies)
-		body->IntegrateVelocities(dt);
+	// A body pulled into a finer tier by its island steps over a shorter time, or on this tick when its own tier does not
+	for (std::size_t i = 0; i < m_dynamicBodies.size(); i++)
+	{
+		RigidBody* body = m_dynamicBodies[i];
+		const float stepTime = tierStepTime(body->m_lodTier);
+		const float distanceStepTime = tierStepTime(m_lodDistanceTiers[i]);
+		if (stepTime == distanceStepTime)
+			continue;
+
+		if (distanceStepTime == 0.0f)
+		{
+			StartStep(body, stepTime);
+		}
+		else if (m_solver != SOLVER_SOFT_STEP)
+		{
+			body->m_velocity += body->m_acceleration * (stepTime - distanceStepTime);
+			body->m_angularVelocity += body->m_angularAcceleration * (stepTime - distanceStepTime);
+		}
+	}
+
+	for (auto& tier : m_lodTiers)
+	{
+		tier.bodies.clear();
+		tier.pairs.clear();
+		tier.circlePairs.clear();
+		tier.joints.clear();
+	}
+
+	// Static bodies stay in tier 0, a pair or a joint is in the tier of its dynamic bodies
+	for (const auto body : m_dynamicBodies)
+		m_lodTiers[body->m_lodTier].bodies.push_back(body);
+
+	for (const auto& pair : m_pairs)
+		m_lodTiers[std::max(pair.a->m_lodTier, pair.b->m_lodTier)].pairs.push_back(pair);
+
+	for (const auto& pair : m_circlePairs)
+		m_lodTiers[std::max(pair.a->m_lodTier, pair.b->m_lodTier)].circlePairs.push_back(pair);
+
+	for (const auto constraint : m_constraints)
+		m_lodTiers[std::max(constraint->a->m_lodTier, constraint->b->m_lodTier)].joints.push_back(constraint);
+
+	// A tier steps on the ticks its rate divides, over the time of all the ticks since it last stepped. The islands of
+	// two tiers share no pair, each tier is stepped on its own with the world only seeing its bodies.
+	// A longer step needs more solver work to hold a stack as well: (2 + tier) / 2 times the iterations and substeps
+	// keep the far piles as steady as on every tick, for half the solver time in the last tier.
+	const int maxIterations = m_maxIterations;
+	const int positionIterations = m_positionIterations;
+	const int substeps = m_substeps;
+	std::vector<PenetrationConstraint> tierPenetrations;
+
+	// The solver stats of the tiers are added up, with the largest residual
+	int iterationCount = 0;
+	int positionIterationCount = 0;
+	float residual = 0.0f;
+	m_steppedLodTiers = 0;
+	for (int tier = 0; tier < LOD_TIER_COUNT; tier++)
+	{
+		LodTier& lod = m_lodTiers[tier];
+		const uint64_t rate = 1ULL << tier;
+		if ((m_lodTick + 1) % rate != 0)
+		{
+			// The bodies stay where they are, and so do their contacts and SAT cache entries. Their last step is drawn
+			// over the ticks until the next one.
+			for (const auto body : lod.bodies)
+				body->m_ticksSinceStep++;
+
+			for (const auto& pair : lod.pairs)
+			{
+				const auto it = m_satCache.find({pair.a, pair.b});
+				if (it != m_satCache.end())
+					it->second.isUsed = true;
+			}
+
+			for (const auto& pairs : {&lod.pairs, &lod.circlePairs})
+			{
+				for (const auto& pair : *pairs)
+				{
+					const auto it = m_contactImpulses.find({pair.a, pair.b});
+					if (it != m_contactImpulses.end())
+						it->second.isUsed = true;
+				}
+			}
+
+			m_stepStats.lodSkippedBodies += static_cast<int>(lod.bodies.size());
+			continue;
+		}
+
+		m_steppedLodTiers |= 1U << tier;
+		if (lod.bodies.empty())
+			continue;
+
+		for (const auto body : lod.bodies)
+		{
+			body->m_stepTicks = static_cast<int>(rate);
+			body->m_ticksSinceStep = 0;
+		}
+
+		m_dynamicBodies.swap(lod.bodies);
+		m_pairs.swap(lod.pairs);
+		m_circlePairs.swap(lod.circlePairs);
+		m_constraints.swap(lod.joints);
+
+		// The contact pairs point in the constraints of the tier, moved after the ones of the finer tiers
+		const std::size_t firstContactPair = m_contactPairs.size();
+		m_maxIterations = (maxIterations * (2 + tier) + 1) / 2;
+		m_positionIterations = (positionIterations * (2 + tier) + 1) / 2;
+		m_substeps = (substeps * (2 + tier) + 1) / 2;
+		tierPenetrations.clear();
+		m_stepStats.iterations = 0;
+		m_stepStats.positionIterations = 0;
+		m_stepStats.residual = 0.0f;
+		StepBodies(tierPenetrations, dt * static_cast<float>(rate), true);
+		iterationCount += m_stepStats.iterations;
+		positionIterationCount += m_stepStats.positionIterations;
+		residual = std::max(residual, m_stepStats.residual);
+
+		for (std::size_t i = firstContactPair; i < m_contactPairs.size(); i++)
+			m_contactPairs[i].firstPenetration += penetrations.size();
+
+		penetrations.insert(penetrations.end(), std::make_move_iterator(tierPenetrations.begin()), std::make_move_iterator(tierPenetrations.end()));
+
+		m_dynamicBodies.swap(lod.bodies);
+		m_pairs.swap(lod.pairs);
+		m_circlePairs.swap(lod.circlePairs);
+		m_constraints.swap(lod.joints);
+	}
+
+	m_maxIterations = maxIterations;
+	m_positionIterations = positionIterations;
+	m_substeps = substeps;
+	m_stepStats.iterations = iterationCount;
+	m_stepStats.positionIterations = positionIterationCount;
+	m_stepStats.residual = residual;
+	m_lodTick++;
+}
+
+void World::BuildIslands()
+{
+	const std::size_t count = m_dynamicBodies.size();
+	m_islandParents.resize(count);
+	m_islandTiers.assign(count, LOD_TIER_COUNT - 1);
+	for (std::size_t i = 0; i < count; i++)
+		m_islandParents[i] = i;
+
+	const auto findRoot = [this](std::size_t i)
+	{
+		while (m_islandParents[i] != i)
+		{
+			m_islandParents[i] = m_islandParents[m_islandParents[i]];
+			i = m_islandParents[i];
+		}
+
+		return i;
+	};
+
+	// Static bodies do not carry anything from one body to another, they link no island
+	const auto link = [&findRoot, this](const RigidBody* a, const RigidBody* b)
+	{
+		if (a->IsStatic() || b->IsStatic())
+			return;
+
+		const std::size_t rootA = findRoot(a->m_lodIndex);
+		const std::size_t rootB = findRoot(b->m_lodIndex);
+		if (rootA != rootB)
+			m_islandParents[std::max(rootA, rootB)] = std::min(rootA, rootB);
+	};
+
+	for (const auto& pair : m_pairs)
+		link(pair.a, pair.b);
+
+	for (const auto& pair : m_circlePairs)
+		link(pair.a, pair.b);
+
+	for (const auto constraint : m_constraints)
+		link(constraint->a, constraint->b);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		int& tier = m_islandTiers[findRoot(i)];
+		tier = std::min(tier, m_dynamicBodies[i]->m_lodTier);
+	}
+
+	for (std::size_t i = 0; i < count; i++)
+		m_dynamicBodies[i]->m_lodTier = m_islandTiers[findRoot(i)];
+}
+
+const ContactEvents& World::GetContactEvents() const
+{
+	return m_contactEvents;
+}
+
+const SensorEvents& World::GetSensorEvents() const
+{
+	return m_sensorEvents;
+}
+
+void World::FindAllPairs(const float dt)
+{
+	if (m_isStaticTreeDirty)
+	{
+		m_staticTree.Build(m_staticBodies);
+		m_isStaticTreeDirty = false;
+	}
+
+	// Update bounding circles for the speculative margins, the static ones never change
+	ParallelFor(m_dynamicBodies.size(), GrainSize(m_dynamicBodies.size(), MIN_BODIES_PER_JOB), [this](const std::size_t first, const std::size_t last)
+	{
+		for (std::size_t i = first; i < last; i++)
+			m_dynamicBodies[i]->UpdateBoundingRadius();
+	});
+
+	// Broad phase on ranges of dynamic bodies, then the pairs of every range in the order of the bodies
+	const std::size_t grain = GrainSize(m_dynamicBodies.size(), MIN_BROAD_PHASE_BODIES_PER_JOB);
+	const std::size_t rangeCount = (m_dynamicBodies.size() + grain - 1) / grain;
+	if (m_pairRanges.size() < rangeCount)
+		m_pairRanges.resize(rangeCount);
+
+	ParallelFor(m_dynamicBodies.size(), grain, [this, dt, grain](const std::size_t first, const std::size_t last)
+	{
+		FindPairs(first, last, dt, m_pairRanges[first / grain]);
+	});
+
+	m_pairs.clear();
+	m_circlePairs.clear();
+	m_contactPairs.clear();
+	m_sensorPairs.clear();
+	for (std::size_t i = 0; i < rangeCount; i++)
+	{
+		const PairRange& range = m_pairRanges[i];
+		m_pairs.insert(m_pairs.end(), range.pairs.begin(), range.pairs.end());
+		m_circlePairs.insert(m_circlePairs.end(), range.circlePairs.begin(), range.circlePairs.end());
+		m_sensorPairs.insert(m_sensorPairs.end(), range.sensorPairs.begin(), range.sensorPairs.end());
+		m_stepStats.filteredPairs += range.filteredPairs;
+	}
+}
+
+void World::NarrowPhase(std::vector<PenetrationConstraint>& penetrations)
+{
+	m_stepStats.narrowPhaseTests += static_cast<int>(m_pairs.size() + m_circlePairs.size());
+
+	TestPairs(penetrations);
+	TestCirclePairs(penetrations);
+}
+
+void World::PruneSatCache()
+{
+	// Forget the pairs that did not pass the broad phase this step
+	for (auto it = m_satCache.begin(); it != m_satCache.end();)
+	{
+		if (it->second.isUsed == false)
+		{
+			it = m_satCache.erase(it);
+		}
+		else
+		{
+			it->second.isUsed = false;
+			++it;
+		}
+	}
+}
+
+void World::PruneContactImpulses()
+{
+	// Forget the pairs that were not solved this step
+	for (auto it = m_contactImpulses.begin(); it != m_contactImpulses.end();)
+	{
+		if (it->second.isUsed == false)
+		{
+			it = m_contactImpulses.erase(it);
+		}
+		else
+		{
+			it->second.isUsed = false;
+			++it;
+		}
+	}
+}
+
+void World::FindPairs(const std::size_t first, const std::size_t last, const float dt, PairRange& outRange) const
+{
+	outRange.pairs.clear();
+	outRange.circlePairs.clear();
+	outRange.sensorPairs.clear();
+	outRange.filteredPairs = 0;
+
+	// Circle pairs are left for the batched test
+	const auto addPair = [&outRange](RigidBody* a, RigidBody* b, const float margin)
+	{
+		if (a->m_shape->GetType() == CIRCLE && b->m_shape->GetType() == CIRCLE)
+			outRange.circlePairs.push_back({a, b, margin});
+		else
+			outRange.pairs.push_back({a, b, margin});
+	};
+
+	for (std::size_t i = first; i < last; i++)
+	{
+		RigidBody* a = m_dynamicBodies[i];
+
+		// Check the rigid body with the next dynamic bodies
+		for (std::size_t j = i + 1; j < m_dynamicBodies.size(); j++)
+		{
+			RigidBody* b = m_dynamicBodies[j];
+
+			// Pairs with a bullet also look for what they can reach during this step, or the step of their tier
+			const bool isSpeculative = a->m_isBullet || b->m_isBullet;
+			float margin = 0.0f;
+			if (isSpeculative)
+			{
+				const float stepTime = dt * static_cast<float>(1 << std::max(a->m_lodTier, b->m_lodTier));
+				margin = ((b->m_velocity - a->m_velocity).Magnitude() + std::abs(a->m_angularVelocity) * a->m_radius + std::abs(b->m_angularVelocity) * b->m_radius) * stepTime;
+			}
+
+			// Broad phase check first, on the boxes of the shapes
+			if (BroadPhaseCollisionCheck(a->m_shape->m_box.Expanded(margin), b->m_shape->m_box) == false)
+				continue;
+
+			if (ShouldCollide(a, b) == false)
+			{
+				outRange.filteredPairs++;
+				continue;
+			}
+
+			// Sensors only need the overlap, tested after the step
+			if (a->m_isSensor || b->m_isSensor)
+			{
+				if (a->m_isSensor != b->m_isSensor)
+					outRange.sensorPairs.push_back(a->m_isSensor ? SensorEvent{a, b} : SensorEvent{b, a});
+
+				continue;
+			}
+
+			// If broad phase passes, the pair goes to the narrow phase. With a margin it also gives speculative contacts,
+			// for the bodies not touching yet but close enough to touch before the end of the step
+			addPair(a, b, margin);
+		}
+
+		// Then with the static bodies around it, found in the static tree. A dynamic sensor skips them.
+		if (a->m_isSensor)
+			continue;
+
+		float margin = 0.0f;
+		if (a->m_isBullet)
+			margin = (a->m_velocity.Magnitude() + std::abs(a->m_angularVelocity) * a->m_radius) * dt * static_cast<float>(1 << a->m_lodTier);
+
+		outRange.staticBodies.clear();
+		m_staticTree.Query(a->m_shape->m_box.Expanded(margin), outRange.staticBodies);
+
+		for (const auto b : outRange.staticBodies)
+		{
+			if (ShouldCollide(a, b) == false)
+				outRange.filteredPairs++;
+			else if (b->m_isSensor)
+				outRange.sensorPairs.push_back({b, a});
+			else
+				addPair(b, a, margin);
+		}
+	}
+}
+
+bool World::ShouldCollide(const RigidBody* a, const RigidBody* b) const
+{
+	// Filter bits first, the joint lookup only when the world has joints keeping bodies apart
+	if (a->m_filter.ShouldCollide(b->m_filter) == false)
+		return false;
+
+	return m_jointPairs.empty() || m_jointPairs.count(OrderedPair(a, b)) == 0;
+}
+
+void World::TestPairs(std::vector<PenetrationConstraint>& penetrations)
+{
+	// Polygon pairs start from the axis SAT found for them on the last step. Their entries are found before the pairs
+	// are split across the job system, which only writes in them.
+	const auto isPolygon = [](const RigidBody* body) { return body->m_shape->GetType() == POLYGON || body->m_shape->GetType() == BOX; };
+	m_pairSatCaches.resize(m_pairs.size());
+	m_pairContactCounts.resize(m_pairs.size());
+	for (std::size_t i = 0; i < m_pairs.size(); i++)
+	{
+		m_pairSatCaches[i] = nullptr;
+		if (isPolygon(m_pairs[i].a) && isPolygon(m_pairs[i].b))
+		{
+			SatCacheEntry& entry = m_satCache[{m_pairs[i].a, m_pairs[i].b}];
+			entry.isUsed = true;
+			m_pairSatCaches[i] = &entry.cache;
+			m_stepStats.satTests++;
+		}
+	}
+
+	const std::size_t grain = GrainSize(m_pairs.size(), MIN_PAIRS_PER_JOB);
+	const std::size_t rangeCount = (m_pairs.size() + grain - 1) / grain;
+	if (m_contactRanges.size() < rangeCount)
+		m_contactRanges.resize(rangeCount);
+
+	ParallelFor(m_pairs.size(), grain, [this, grain](const std::size_t first, const std::size_t last)
+	{
+		ContactRange& range = m_contactRanges[first / grain];
+		range.contacts.clear();
+		range.satCacheHits = 0;
+
+		for (std::size_t i = first; i < last; i++)
+		{
+			const BodyPair& pair = m_pairs[i];
+			const std::size_t count = range.contacts.size();
+			bool isSatCacheHit = false;
+			if (IsColliding(pair.a, pair.b, range.contacts, pair.speculativeDistance, m_pairSatCaches[i], &isSatCacheHit) == false)
+				range.contacts.resize(count);
+
+			m_pairContactCounts[i] = range.contacts.size() - count;
+			if (isSatCacheHit)
+				range.satCacheHits++;
+		}
+	});
+
+	// The constraints are added in the order of the pairs
+	std::size_t pairIndex = 0;
+	for (std::size_t i = 0; i < rangeCount; i++)
+	{
+		const ContactRange& range = m_contactRanges[i];
+		m_stepStats.satCacheHits += range.satCacheHits;
+
+		const Contact* contacts = range.contacts.data();
+		for (const std::size_t last = std::min(m_pairs.size(), (i + 1) * grain); pairIndex < last; pairIndex++)
+		{
+			const std::size_t count = m_pairContactCounts[pairIndex];
+			if (count == 0)
+				continue;
+
+			for (std::size_t k = 0; k < count; k++)
+				penetrations.emplace_back(contacts[k].a, contacts[k].b, contacts[k].start, contacts[k].end, contacts[k].normal);
+
+			AddContactPair(contacts, count, penetrations);
+			contacts += count;
+		}
+	}
+}
+
+void World::TestCirclePairs(std::vector<PenetrationConstraint>& penetrations)
+{
+	// Ranges of whole batches, so every pair lands in the same batch of 4 on any number of threads
+	const std::size_t grain = (GrainSize(m_circlePairs.size(), MIN_CIRCLE_PAIRS_PER_JOB) + 3) / 4 * 4;
+	const std::size_t rangeCount = (m_circlePairs.size() + grain - 1) / grain;
+	if (m_contactRanges.size() < rangeCount)
+		m_contactRanges.resize(rangeCount);
+
+	ParallelFor(m_circlePairs.size(), grain, [this, grain](const std::size_t first, const std::size_t last)
+	{
+		ContactRange& range = m_contactRanges[first / grain];
+		range.contacts.clear();
+		IsCollidingCircleCircleBatch(m_circlePairs.data() + first, last - first, range.contacts);
+	});
+
+	for (std::size_t i = 0; i < rangeCount; i++)
+	{
+		for (const auto& contact : m_contactRanges[i].contacts)
+		{
+			penetrations.emplace_back(contact.a, contact.b, contact.start, contact.end, contact.normal);
+			AddContactPair(&contact, 1, penetrations);
+		}
+	}
+}
+
+void World::ReportSensors()
+{
+	m_sensorEvents.begin.clear();
+	m_sensorEvents.end.clear();
+
+	// The bodies moved since the broad phase, the overlap is tested where they ended the step
+	std::vector<SensorEvent> overlaps;
+	std::unordered_set<std::pair<const RigidBody*, const RigidBody*>, BodyPairHash> overlapPairs;
+	for (const auto& pair : m_sensorPairs)
+	{
+		if (IsOverlapping(*pair.sensor->m_shape, *pair.visitor->m_shape) == false)
+			continue;
+
+		const std::pair<const RigidBody*, const RigidBody*> key = {pair.sensor, pair.visitor};
+		if (m_sensorOverlapPairs.count(key) == 0)
+			m_sensorEvents.begin.push_back(pair);
+
+		overlaps.push_back(pair);
+		overlapPairs.insert(key);
+	}
+
+	for (const auto& pair : m_sensorOverlaps)
+	{
+		if (overlapPairs.count({pair.sensor, pair.visitor}) == 0)
+			m_sensorEvents.end.push_back(pair);
+	}
+
+	m_sensorOverlaps.swap(overlaps);
+	m_sensorOverlapPairs.swap(overlapPairs);
+}
+
+void World::AddContactPair(const Contact* contacts, const std::size_t count, const std::vector<PenetrationConstraint>& penetrations)
+{
+	// The deepest point stands for the pair, its constraints are the last ones added
+	const Contact* deepest = contacts;
+	for (std::size_t i = 1; i < count; i++)
+	{
+		if (contacts[i].depth > deepest->depth)
+			deepest = &contacts[i];
+	}
+
+	const ContactEvent event = {deepest->a, deepest->b, (deepest->start + deepest->end) * 0.5f, deepest->normal, 0.0f};
+	m_contactPairs.push_back({event, penetrations.size() - count, count, deepest->depth >= 0.0f});
+}
+
+void World::ReportContacts(const std::vector<PenetrationConstraint>& penetrations)
+{
+	m_contactEvents.begin.clear();
+	m_contactEvents.persist.clear();
+	m_contactEvents.end.clear();
+
+	std::vector<ContactEvent> touching;
+	std::unordered_set<std::pair<const RigidBody*, const RigidBody*>, BodyPairHash> touchingPairs;
+	for (auto& pair : m_contactPairs)
+	{
+		for (std::size_t i = pair.firstPenetration; i < pair.firstPenetration + pair.penetrationCount; i++)
+			pair.event.maxNormalImpulse = std::max(pair.event.maxNormalImpulse, penetrations[i].GetMaxNormalImpulse());
+
+		// A speculative pair only touches if the solver had to stop it
+		if (pair.isOverlapping == false && pair.event.maxNormalImpulse == 0.0f)
+			continue;
+
+		const auto key = OrderedPair(pair.event.a, pair.event.b);
+		if (m_touchingPairs.count(key) > 0)
+			m_contactEvents.persist.push_back(pair.event);
+		else
+			m_contactEvents.begin.push_back(pair.event);
+
+		touching.push_back(pair.event);
+		touchingPairs.insert(key);
+	}
+
+	for (const auto& event : m_touching)
+	{
+		const auto key = OrderedPair(event.a, event.b);
+		if (touchingPairs.count(key) > 0)
+			continue;
+
+		// A pair of a tier that did not step keeps touching, without an event
+		if ((m_steppedLodTiers & (1U << std::max(event.a->m_lodTier, event.b->m_lodTier))) == 0)
+		{
+			touching.push_back(event);
+			touchingPairs.insert(key);
+			continue;
+		}
+
+		m_contactEvents.end.push_back(event);
+	}
+
+	m_touching.swap(touching);
+	m_touchingPairs.swap(touchingPairs);
+}
+
+template <typename JointPass, typename PenetrationPass>
+void World::SolveConstraints(std::vector<PenetrationConstraint>& penetrations, float& inOutImpulse, const JointPass& jointPass,
+                             const PenetrationPass& penetrationPass)
+{
+	if (m_solverOrder == ORDER_SEQUENTIAL)
+	{
+		for (const auto constraint : m_constraints)
+			inOutImpulse += jointPass(*constraint);
+
+		for (auto& constraint : penetrations)
+			inOutImpulse += penetrationPass(constraint);
+
+		return;
+	}
+
+	// The constraints of a color share no dynamic body and run in any order. Their impulses are added up in the order of
+	// the color, not in the order the threads finish them.
+	for (std::size_t color = 0; color < m_colorCount; color++)
+	{
+		const ConstraintColor& constraints = m_colors[color];
+		const std::size_t jointCount = constraints.joints.size();
+		const std::size_t count = jointCount + constraints.penetrations.size();
+		m_constraintImpulses.resize(count);
+
+		const bool isOverflow = color == MAX_CONSTRAINT_COLORS;
+		const std::size_t grain = isOverflow ? std::max<std::size_t>(count, 1) : GrainSize(count, MIN_CONSTRAINTS_PER_JOB);
+		ParallelFor(count, grain, [&](const std::size_t first, const std::size_t last)
+		{
+			for (std::size_t i = first; i < last; i++)
+			{
+				if (i < jointCount)
+					m_constraintImpulses[i] = jointPass(*constraints.joints[i]);
+				else
+					m_constraintImpulses[i] = penetrationPass(penetrations[constraints.penetrations[i - jointCount]]);
+			}
+		});
+
+		for (std::size_t i = 0; i < count; i++)
+			inOutImpulse += m_constraintImpulses[i];
+	}
+}
+
+template <typename JointPass, typename PenetrationPass>
+void World::ForEachConstraint(std::vector<PenetrationConstraint>& penetrations, const JointPass& jointPass, const PenetrationPass& penetrationPass)
+{
+	float impulse = 0.0f;
+	SolveConstraints(penetrations, impulse,
+	                 [&jointPass](JointConstraint& constraint) { jointPass(constraint); return 0.0f; },
+	                 [&penetrationPass](PenetrationConstraint& constraint) { penetrationPass(constraint); return 0.0f; });
+}
+
+void World::ColorConstraints(const std::vector<PenetrationConstraint>& penetrations)
+{
+	// Greedy coloring in the order of the constraints, so the colors only depend on the constraints. Static bodies take
+	// no impulse, any number of constraints of a color can share them.
+	m_bodyColors.clear();
+	const auto findColor = [this](const RigidBody* a, const RigidBody* b)
+	{
+		uint32_t* aColors = a->IsStatic() ? nullptr : &m_bodyColors[a];
+		uint32_t* bColors = b->IsStatic() ? nullptr : &m_bodyColors[b];
+		const uint32_t used = (aColors != nullptr ? *aColors : 0U) | (bColors != nullptr ? *bColors : 0U);
+
+		std::size_t color = 0;
+		while (color < MAX_CONSTRAINT_COLORS && (used & (1U << color)) != 0)
+			color++;
+
+		// Past the last color, the constraints share the overflow color and run one after the other
+		if (color < MAX_CONSTRAINT_COLORS)
+		{
+			if (aColors != nullptr)
+				*aColors |= 1U << color;
+
+			if (bColors != nullptr)
+				*bColors |= 1U << color;
+		}
+
+		m_colorCount = std::max(m_colorCount, color + 1);
+		return color;
+	};
+
+	for (auto& color : m_colors)
+	{
+		color.joints.clear();
+		color.penetrations.clear();
+	}
+
+	m_colorCount = 0;
+	for (const auto constraint : m_constraints)
+		m_colors[findColor(constraint->a, constraint->b)].joints.push_back(constraint);
+
+	for (std::size_t i = 0; i < penetrations.size(); i++)
+		m_colors[findColor(penetrations[i].a, penetrations[i].b)].penetrations.push_back(i);
+}
+
+void World::WarmStartContacts(std::vector<PenetrationConstraint>& penetrations)
+{
+	// The contacts are rebuilt every step, a contact takes the normal impulse of the closest point of its pair on the last
+	// step. The friction row is solved together with the normal row and its bias, carried over it would keep what the
+	// bias added and the stacks would slide.
+	for (std::size_t first = 0; first < penetrations.size();)
+	{
+		RigidBody* a = penetrations[first].a;
+		RigidBody* b = penetrations[first].b;
+		std::size_t last = first + 1;
+		while (last < penetrations.size() && penetrations[last].a == a && penetrations[last].b == b)
+			last++;
+
+		const auto it = m_contactImpulses.find({a, b});
+		if (it != m_contactImpulses.end())
+		{
+			const ContactImpulseEntry& entry = it->second;
+			bool isTaken[MAX_CACHED_CONTACTS] = {};
+			for (std::size_t i = first; i < last; i++)
+			{
+				const Vec2 offset = a->LocalToWorld(penetrations[i].aPoint) - a->m_position;
+				int closest = -1;
+				float closestDistance = CONTACT_MATCH_DISTANCE * CONTACT_MATCH_DISTANCE;
+				for (int k = 0; k < entry.count; k++)
+				{
+					const float distance = (entry.offsets[k] - offset).MagnitudeSquared();
+					if (isTaken[k] == false && distance <= closestDistance)
+					{
+						closest = k;
+						closestDistance = distance;
+					}
+				}
+
+				if (closest < 0)
+					continue;
+
+				isTaken[closest] = true;
+				penetrations[i].SetCachedLambda(0, entry.normalImpulses[closest]);
+			}
+		}
+
+		first = last;
+	}
+}
+
+void World::CacheContactImpulses(const std::vector<PenetrationConstraint>& penetrations)
+{
+	for (const auto& constraint : penetrations)
+	{
+		ContactImpulseEntry& entry = m_contactImpulses[{constraint.a, constraint.b}];
+		if (entry.isUsed == false)
+		{
+			entry.count = 0;
+			entry.isUsed = true;
+		}
+
+		if (entry.count == MAX_CACHED_CONTACTS)
+			continue;
+
+		entry.offsets[entry.count] = constraint.a->LocalToWorld(constraint.aPoint) - constraint.a->m_position;
+		entry.normalImpulses[entry.count] = constraint.GetCachedLambda(0);
+		entry.count++;
+	}
+}
+
+void World::SolveIterative(std::vector<PenetrationConstraint>& penetrations, const float dt)
+{
+	if (m_solverOrder == ORDER_COLORED)
+		ColorConstraints(penetrations);
+
+	WarmStartContacts(penetrations);
+
+	// Solve all constraints
+	ForEachConstraint(penetrations, [dt](JointConstraint& constraint) { constraint.PreSolve(dt); },
+	                  [dt](PenetrationConstraint& constraint) { constraint.PreSolve(dt); });
+
+	const bool splitImpulse = m_positionCorrection == CORRECTION_SPLIT_IMPULSE;
+	if (splitImpulse)
+	{
+		for (auto& constraint : penetrations)
+			constraint.PrepareSplitImpulse(dt);
+	}
+
+	if (m_constraints.empty() == false || penetrations.empty() == false)
+	{
+		// The warm starting counts in the impulse of the step, a contact resting like on the last step converges at once
+		float accumulatedImpulse = 0.0f;
+		for (const auto constraint : m_constraints)
+			accumulatedImpulse += constraint->GetAccumulatedImpulse();
+
+		for (const auto& constraint : penetrations)
+			accumulatedImpulse += constraint.GetAccumulatedImpulse();
+
+		// Iterate until the impulses applied by one iteration are small compared to the total impulse of the step
+		for (int i = 0; i < m_maxIterations; ++i)
+		{
+			float appliedImpulse = 0.0f;
+			SolveConstraints(penetrations, appliedImpulse, [](JointConstraint& constraint) { return constraint.Solve(); },
+			                 [](PenetrationConstraint& constraint) { return constraint.Solve(); });
+
+			accumulatedImpulse += appliedImpulse;
+			m_stepStats.iterations = i + 1;
+			m_stepStats.residual = accumulatedImpulse > 0.0f ? appliedImpulse / accumulatedImpulse : 0.0f;
+
+			if (m_stepStats.residual <= m_tolerance)
+				break;
+		}
+	}
+
+	for (const auto constraint : m_constraints)
+		constraint->PostSolve();
+
+	for (auto& constraint : penetrations)
+		constraint.PostSolve();
+
+	CacheContactImpulses(penetrations);
+
+	if (splitImpulse && penetrations.empty() == false)
+	{
+		// Push the bodies apart with pseudo velocities, they are added to the motion of this step only
+		float accumulatedImpulse = 0.0f;
+		for (int i = 0; i < m_positionIterations; ++i)
+		{
+			float appliedImpulse = 0.0f;
+			SolveConstraints(penetrations, appliedImpulse, [](JointConstraint&) { return 0.0f; },
+			                 [](PenetrationConstraint& constraint) { return constraint.SolvePosition(); });
+
+			accumulatedImpulse += appliedImpulse;
+			m_stepStats.positionIterations = i + 1;
+
+			if (appliedImpulse <= m_tolerance * accumulatedImpulse)
+				break;
+		}
+	}
+
+	// Integrate all the velocities, positions and world vertices are updated once here
+	ParallelFor(m_dynamicBodies.size(), GrainSize(m_dynamicBodies.size(), MIN_BODIES_PER_JOB), [this, dt](const std::size_t first, const std::size_t last)
+	{
+		for (std::size_t i = first; i < last; i++)
+			m_dynamicBodies[i]->IntegrateVelocities(dt);
+	});
+}
+
+void World::SolveSoftStep(std::vector<PenetrationConstraint>& penetrations, const float dt)
+{
+	const float h = dt / static_cast<float>(m_substeps);
+
+	if (m_solverOrder == ORDER_COLORED)
+		ColorConstraints(penetrations);
+
+	// Jacobians and effective masses are computed once for the whole step
+	for (const auto constraint : m_constraints)
+		constraint->Prepare(h);
+
+	for (auto& constraint : penetrations)
+		constraint.Prepare(h);
+
+	// The soft step always runs one iteration per substep, the residual is measured on the relax pass
+	m_stepStats.iterations = m_substeps;
+	float accumulatedImpulse = 0.0f;
+
+	const std::size_t grain = GrainSize(m_dynamicBodies.size(), MIN_BODIES_PER_JOB);
+	for (int substep = 0; substep < m_substeps; substep++)
+	{
+		const bool isLastSubstep = substep == m_substeps - 1;
+		ParallelFor(m_dynamicBodies.size(), grain, [this, h, isLastSubstep](const std::size_t first, const std::size_t last)
+		{
+			for (std::size_t i = first; i < last; i++)
+				m_dynamicBodies[i]->IntegrateForces(h, isLastSubstep);
+		});
+
+		ForEachConstraint(penetrations, [](JointConstraint& constraint) { constraint.WarmStart(); },
+		                  [](PenetrationConstraint& constraint) { constraint.WarmStart(); });
+
+		// Solve with the soft bias pushing the bodies apart
+		SolveConstraints(penetrations, accumulatedImpulse, [h](JointConstraint& constraint) { return constraint.SolveSoft(h, true); },
+		                 [h](PenetrationConstraint& constraint) { return constraint.SolveSoft(h, true); });
+
+		ParallelFor(m_dynamicBodies.size(), grain, [this, h](const std::size_t first, const std::size_t last)
+		{
+			for (std::size_t i = first; i < last; i++)
+				m_dynamicBodies[i]->IntegrateVelocities(h);
+		});
+
+		// Relax: solve again without bias to remove the velocity the bias added
+		float appliedImpulse = 0.0f;
+		SolveConstraints(penetrations, appliedImpulse, [h](JointConstraint& constraint) { return constraint.SolveSoft(h, false); },
+		                 [h](PenetrationConstraint& constraint) { return constraint.SolveSoft(h, false); });
+
+		accumulatedImpulse += appliedImpulse;
+		m_stepStats.residual = accumulatedImpulse > 0.0f ? appliedImpulse / accumulatedImpulse : 0.0f;
+	}
+
+	ForEachConstraint(penetrations, [](JointConstraint&) {}, [](PenetrationConstraint& constraint) { constraint.ApplyRestitution(); });
+
+	for (const auto constraint : m_constraints)
+		constraint->PostSolve();
+}
+
+void World::SolveTimeOfImpact() const
+{
+	// Bullets that still went through something during the step are moved back to where they first touched it. The
+	// dynamic bodies come from the pairs of the broad phase, where the boxes of the bullets were swept by their speed, and
+	// every pair is tested once so two bullets both stop at the time they touch.
+	std::unordered_map<const RigidBody*, float> timesOfImpact;
+	const auto lowerTimeOfImpact = [&timesOfImpact](const RigidBody* bullet, const float timeOfImpact)
+	{
+		const auto inserted = timesOfImpact.emplace(bullet, timeOfImpact);
+		if (inserted.second == false)
+			inserted.first->second = std::min(inserted.first->second, timeOfImpact);
+	};
+
+	const auto testPairs = [&lowerTimeOfImpact](const std::vector<BodyPair>& pairs)
+	{
+		for (const BodyPair& pair : pairs)
+		{
+			const bool aIsBullet = pair.a->m_isBullet && pair.a->m_isSensor == false;
+			const bool bIsBullet = pair.b->m_isBullet && pair.b->m_isSensor == false;
+			if ((aIsBullet == false && bIsBullet == false) || pair.a->IsStatic() || pair.b->IsStatic())
+				continue;
+
+			const float timeOfImpact = ComputeTimeOfImpact(pair.a, pair.b, TIME_OF_IMPACT_TARGET);
+			if (timeOfImpact >= 1.0f)
+				continue;
+
+			if (aIsBullet)
+				lowerTimeOfImpact(pair.a, timeOfImpact);
+
+			if (bIsBullet)
+				lowerTimeOfImpact(pair.b, timeOfImpact);
+		}
+	};
+
+	testPairs(m_pairs);
+	testPairs(m_circlePairs);
+
+	// The static bodies are found in the static tree with the box around the whole motion of the bullet. The bullets
+	// are only moved once every time of impact is known, so the result does not depend on their order.
+	std::vector<RigidBody*> others;
+	for (const auto bullet : m_dynamicBodies)
+	{
+		if (bullet->m_isBullet == false || bullet->m_isSensor)
+			continue;
+
+		const Vec2 extent(bullet->m_radius, bullet->m_radius);
+		const AABB startBox = {bullet->m_previousPosition - extent, bullet->m_previousPosition + extent};
+		const AABB endBox = {bullet->m_position - extent, bullet->m_position + extent};
+
+		others.clear();
+		m_staticTree.Query(startBox.Union(endBox), others);
+
+		for (const auto other : others)
+		{
+			if (other->m_isSensor == false && ShouldCollide(bullet, other))
+			{
+				const float timeOfImpact = ComputeTimeOfImpact(bullet, other, TIME_OF_IMPACT_TARGET);
+				if (timeOfImpact < 1.0f)
+					lowerTimeOfImpact(bullet, timeOfImpact);
+			}
+		}
+	}
+
+	for (const auto bullet : m_dynamicBodies)
+	{
+		const auto found = timesOfImpact.find(bullet);
+		if (found == timesOfImpact.end())
+			continue;
+
+		const float timeOfImpact = found->second;
+		bullet->m_position = bullet->m_previousPosition + (bullet->m_position - bullet->m_previousPosition) * timeOfImpact;
+		bullet->m_rotation = bullet->m_previousRotation + (bullet->m_rotation - bullet->m_previousRotation) * timeOfImpact;
+		bullet->m_shape->UpdateVertices(bullet->m_position, bullet->m_rotation);
+	}
+}
+
+bool World::RayCast(const Vec2& start, const Vec2& end, RayCastHit& outHit) const
+{
+	outHit = RayCastHit();
+
+	std::vector<RigidBody*> candidates;
+	RayCastBroadPhase(start, end, candidates);
+
+	float fraction;
+	Vec2 normal;
+	for (const auto body : candidates)
+	{
+		if (body->m_isSensor == false && body->m_shape->RayCast(start, end, fraction, normal) && (outHit.body == nullptr || fraction < outHit.fraction))
+			outHit = {body, start + (end - start) * fraction, normal, fraction};
+	}
+
+	return outHit.body != nullptr;
+}
+
+void World::RayCastAll(const Vec2& start, const Vec2& end, std::vector<RayCastHit>& outHits) const
+{
+	std::vector<RigidBody*> candidates;
+	RayCastBroadPhase(start, end, candidates);
+
+	const std::size_t first = outHits.size();
+	float fraction;
+	Vec2 normal;
+	for (const auto body : candidates)
+	{
+		if (body->m_isSensor == false && body->m_shape->RayCast(start, end, fraction, normal))
+			outHits.push_back({body, start + (end - start) * fraction, normal, fraction});
+	}
+
+	std::stable_sort(outHits.begin() + static_cast<std::ptrdiff_t>(first), outHits.end(), [](const RayCastHit& lhs, const RayCastHit& rhs)
+	{
+		return lhs.fraction < rhs.fraction;
+	});
+}
+
+void World::RayCastBatch(const std::vector<RayCastInput>& rays, std::vector<RayCastHit>& outHits) const
+{
+	outHits.resize(rays.size());
+
+	// Every range writes its own hits
+	ParallelFor(rays.size(), GrainSize(rays.size(), MIN_RAYS_PER_JOB), [this, &rays, &outHits](const std::size_t first, const std::size_t last)
+	{
+		for (std::size_t i = first; i < last; i++)
+			RayCast(rays[i].start, rays[i].end, outHits[i]);
+	});
+}
+
+void World::QueryAABB(const AABB& box, std::vector<RigidBody*>& outBodies) const
+{
+	QueryBroadPhase(box, outBodies);
+}
+
+void World::QueryPoint(const Vec2& point, std::vector<RigidBody*>& outBodies) const
+{
+	// The candidates are written after the bodies already in the output, then filtered in place
+	const std::size_t first = outBodies.size();
+	QueryBroadPhase({point, point}, outBodies);
+
+	const auto last = std::remove_if(outBodies.begin() + static_cast<std::ptrdiff_t>(first), outBodies.end(), [&point](const RigidBody* body)
+	{
+		return body->m_shape->TestPoint(point) == false;
+	});
+	outBodies.erase(last, outBodies.end());
+}
+
+void World::QueryShape(const Shape& shape, std::vector<RigidBody*>& outBodies) const
+{
+	const std::size_t first = outBodies.size();
+	QueryBroadPhase(shape.m_box, outBodies);
+
+	const auto last = std::remove_if(outBodies.begin() + static_cast<std::ptrdiff_t>(first), outBodies.end(), [&shape](const RigidBody* body)
+	{
+		return IsOverlapping(shape, *body->m_shape) == false;
+	});
+	outBodies.erase(last, outBodies.end());
+}
+
+void World::QueryBroadPhase(const AABB& box, std::vector<RigidBody*>& outBodies) const
+{
+	// The static tree is built by the step, until then the static bodies are tested one by one
+	if (m_isStaticTreeDirty)
+	{
+		for (const auto body : m_staticBodies)
+		{
+			if (body->m_shape->m_box.Overlaps(box))
+				outBodies.push_back(body);
+		}
+	}
+	else
+	{
+		m_staticTree.Query(box, outBodies);
+	}
+
+	// The dynamic bodies have no tree, their broad phase tests all the pairs
+	for (const auto body : m_dynamicBodies)
+	{
+		if (body->m_shape->m_box.Overlaps(box))
+			outBodies.push_back(body);
+	}
+}
+
+void World::RayCastBroadPhase(const Vec2& start, const Vec2& end, std::vector<RigidBody*>& outBodies) const
+{
+	if (m_isStaticTreeDirty)
+	{
+		for (const auto body : m_staticBodies)
+		{
+			if (body->m_shape->m_box.IntersectsSegment(start, end))
+				outBodies.push_back(body);
+		}
+	}
+	else
+	{
+		m_staticTree.RayCast(start, end, outBodies);
+	}
+
+	for (const auto body : m_dynamicBodies)
+	{
+		if (body->m_shape->m_box.IntersectsSegment(start, end))
+			outBodies.push_back(body);
+	}
 }
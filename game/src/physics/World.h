@@ -1,32 +1,450 @@
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "BodyPair.h"
+#include "SatCache.h"
+#include "StaticTree.h"
 #include "Vec2.h"
 
+class JobSystem;
+struct Contact;
 struct JointConstraint;
+struct PenetrationConstraint;
 class RigidBody;
+class Shape;
+
+enum SolverType : uint8_t
+{
+	SOLVER_ITERATIVE, // Baumgarte stabilized Gauss-Seidel, a fixed number of iterations per step
+	SOLVER_SOFT_STEP // Substeps with one soft constraint iteration each, then a relax pass and a restitution pass
+};
+
+enum PositionCorrection : uint8_t
+{
+	CORRECTION_BAUMGARTE, // The contact position error biases the velocity solve
+	CORRECTION_SPLIT_IMPULSE // The contact position error is solved separately on pseudo velocities that only move the bodies
+};
+
+// Contact between two bodies, reported after the step
+struct ContactEvent
+{
+	RigidBody* a;
+	RigidBody* b;
+	Vec2 point; // Deepest point of the pair when it was detected, halfway between the surfaces
+	Vec2 normal; // From a to b
+	float maxNormalImpulse; // Largest normal impulse on one point of the pair during the step
+};
+
+// Contact events of the last step, in the order the pairs were detected. A pair touches when it overlaps, or when the
+// solver had to push it apart to stop it from overlapping during the step.
+struct ContactEvents
+{
+	std::vector<ContactEvent> begin; // Pairs touching on this step and not on the last one
+	std::vector<ContactEvent> persist; // Pairs touching on both steps
+	std::vector<ContactEvent> end; // Pairs touching on the last step and not on this one, as they were then
+};
+
+// Body overlapping a sensor
+struct SensorEvent
+{
+	RigidBody* sensor;
+	RigidBody* visitor;
+};
+
+// Sensor events of the last step, in the order the pairs were detected
+struct SensorEvents
+{
+	std::vector<SensorEvent> begin; // Bodies that started overlapping a sensor
+	std::vector<SensorEvent> end; // Bodies that stopped overlapping a sensor
+};
+
+// Entry of the SAT cache, saved and restored with the bodies: the cache changes which axis the next steps use, a world
+// restored without it does not give the same steps again
+struct SatCacheRecord
+{
+	const RigidBody* a;
+	const RigidBody* b;
+	SatCache cache;
+};
+
+// Normal impulse of a contact point at the end of the last step, the iterative solver starts the same point of the next
+// step from it. Saved and restored with the bodies like the SAT cache.
+struct ContactImpulseRecord
+{
+	const RigidBody* a;
+	const RigidBody* b;
+	Vec2 offset; // Contact point on A, relative to its position
+	float normalImpulse;
+};
+
+enum SolverOrder : uint8_t
+{
+	ORDER_SEQUENTIAL, // The constraints one after the other on the calling thread, joints first
+	ORDER_COLORED // The constraints in colors sharing no dynamic body, each color split across the job system
+};
+
+enum WorldCommandType : uint8_t
+{
+	COMMAND_ADD_BODY,
+	COMMAND_REMOVE_BODY,
+	COMMAND_SET_VELOCITY,
+	COMMAND_ADD_CONSTRAINT,
+	COMMAND_REMOVE_CONSTRAINT
+};
+
+// Change to the world queued until the next flush
+struct WorldCommand
+{
+	WorldCommandType type;
+	RigidBody* body;
+	JointConstraint* constraint;
+	Vec2 velocity;
+	float angularVelocity;
+};
+
+// Solver results of the last step
+struct StepStats
+{
+	// With level of detail, the iterations are added up over the tiers stepped on the tick and the residual is the largest one
+	int iterations = 0; // Iterations run by the iterative solver, substeps for the soft step
+	float residual = 0.0f; // Impulse applied by the last iteration, relative to the impulse accumulated during the step
+	int positionIterations = 0; // Split impulse iterations
+	int filteredPairs = 0; // Pairs that passed the broad phase, dropped by the collision filters and the joints
+	int narrowPhaseTests = 0; // Pairs that passed the broad phase and the filters
+	int satTests = 0; // Polygon pairs among them
+	int satCacheHits = 0; // Polygon pairs solved from the axis cached on the last step, without full SAT
+
+	// Wall time of the step and of its phases, in microseconds
+	float stepTime = 0.0f;
+	float collisionTime = 0.0f; // Broad and narrow phase
+	float solveTime = 0.0f; // Constraints and integration
+
+	int lodSkippedBodies = 0; // Dynamic bodies of the level of detail tiers that did not step on this tick
+};
+
+struct RayCastInput
+{
+	Vec2 start;
+	Vec2 end;
+};
+
+struct RayCastHit
+{
+	RigidBody* body = nullptr; // Null when the ray hit nothing
+	Vec2 point;
+	Vec2 normal; // Surface normal of the body at the point
+	float fraction = 0.0f; // Of the ray, from its start
+};
 
 class World
 {
 private:
 	float m_gravity;
 	std::vector<RigidBody*> m_bodies;
+	std::vector<RigidBody*> m_staticBodies; // Partitions of m_bodies, a body is sorted when added
+	std::vector<RigidBody*> m_dynamicBodies;
+	StaticTree m_staticTree;
+	bool m_isStaticTreeDirty = false;
 	std::vector<JointConstraint*> m_constraints;
+	std::unordered_set<const RigidBody*> m_bodySet; // What the world holds, for the commands
+	std::unordered_set<const JointConstraint*> m_constraintSet;
+
+	struct BodyPairHash
+	{
+		std::size_t operator()(const std::pair<const RigidBody*, const RigidBody*>& pair) const
+		{
+			const std::size_t first = std::hash<const RigidBody*>()(pair.first);
+			return first ^ (std::hash<const RigidBody*>()(pair.second) + 0x9e3779b9 + (first << 6) + (first >> 2));
+		}
+	};
+
+	struct SatCacheEntry
+	{
+		SatCache cache;
+		bool isUsed = false;
+	};
+
+	// Contact points of a pair solved on the last step, at most two are kept
+	static constexpr int MAX_CACHED_CONTACTS = 2;
+
+	struct ContactImpulseEntry
+	{
+		Vec2 offsets[MAX_CACHED_CONTACTS];
+		float normalImpulses[MAX_CACHED_CONTACTS];
+		int count = 0;
+		bool isUsed = false;
+	};
+
+	// Pairs joined by a joint that does not let them collide
+	std::unordered_set<std::pair<const RigidBody*, const RigidBody*>, BodyPairHash> m_jointPairs;
+
+	// Polygon pairs that passed the broad phase on the last step, the others are dropped
+	std::unordered_map<std::pair<const RigidBody*, const RigidBody*>, SatCacheEntry, BodyPairHash> m_satCache;
+
+	// Pairs with contacts solved by the iterative solver on the last step, the others are dropped with the SAT cache
+	std::unordered_map<std::pair<const RigidBody*, const RigidBody*>, ContactImpulseEntry, BodyPairHash> m_contactImpulses;
+
+	// Pairs that passed the broad phase and the filters. The circle pairs are tested together after the other pairs.
+	std::vector<BodyPair> m_pairs;
+	std::vector<BodyPair> m_circlePairs;
+	std::vector<SatCache*> m_pairSatCaches; // Entry of every pair in the SAT cache, null for the pairs that are not polygons
+	std::vector<std::size_t> m_pairContactCounts;
+
+	// Results of one range of bodies or pairs of a phase split across the job system. The ranges are merged in their
+	// order, so the pairs and contacts come out in the order one thread finds them in.
+	struct PairRange
+	{
+		std::vector<BodyPair> pairs;
+		std::vector<BodyPair> circlePairs;
+		std::vector<SensorEvent> sensorPairs;
+		std::vector<RigidBody*> staticBodies;
+		int filteredPairs = 0;
+	};
+
+	struct ContactRange
+	{
+		std::vector<Contact> contacts;
+		int satCacheHits = 0;
+	};
+
+	std::vector<PairRange> m_pairRanges;
+	std::vector<ContactRange> m_contactRanges;
+	JobSystem* m_jobSystem = nullptr;
+
+	// Colors of the constraints of the step, in the order the constraints come in. The last color holds the overflow,
+	// solved on one thread.
+	static constexpr std::size_t MAX_CONSTRAINT_COLORS = 32;
+
+	struct ConstraintColor
+	{
+		std::vector<JointConstraint*> joints;
+		std::vector<std::size_t> penetrations; // Indices in the penetrations of the step
+	};
+
+	SolverOrder m_solverOrder = ORDER_SEQUENTIAL;
+	ConstraintColor m_colors[MAX_CONSTRAINT_COLORS + 1];
+	std::size_t m_colorCount = 0;
+	std::unordered_map<const RigidBody*, uint32_t> m_bodyColors; // Colors taken by the constraints of each dynamic body
+	std::vector<float> m_constraintImpulses; // Applied by each constraint of a color, added up in their order
+
+	// Pairs with contacts on this step, with the range of their penetration constraints
+	struct ContactPair
+	{
+		ContactEvent event;
+		std::size_t firstPenetration;
+		std::size_t penetrationCount;
+		bool isOverlapping;
+	};
+
+	std::vector<ContactPair> m_contactPairs;
+	ContactEvents m_contactEvents;
+	std::vector<ContactEvent> m_touching; // Pairs touching at the end of the last step, in their order
+	std::unordered_set<std::pair<const RigidBody*, const RigidBody*>, BodyPairHash> m_touchingPairs;
+
+	// Sensor pairs that passed the broad phase, tested for overlap once the bodies moved
+	std::vector<SensorEvent> m_sensorPairs;
+	SensorEvents m_sensorEvents;
+	std::vector<SensorEvent> m_sensorOverlaps; // Pairs overlapping at the end of the last step, in their order
+	std::unordered_set<std::pair<const RigidBody*, const RigidBody*>, BodyPairHash> m_sensorOverlapPairs;
+
 	std::vector<Vec2> m_forces;
 	std::vector<float> m_torques;
 
+	// Commands queued from any thread, and the ones being applied by the flush
+	std::mutex m_commandMutex;
+	std::vector<WorldCommand> m_commands;
+	std::vector<WorldCommand> m_flushedCommands;
+
+	SolverType m_solver = SOLVER_ITERATIVE;
+	int m_substeps = 4;
+	int m_maxIterations = 10;
+	float m_tolerance = 0.01f;
+	PositionCorrection m_positionCorrection = CORRECTION_BAUMGARTE;
+	int m_positionIterations = 4;
+	StepStats m_stepStats;
+
+	// Simulation level of detail, see SetFocusPoints. The bodies, pairs and joints of every tier are swapped in for the
+	// step of the tier.
+	static constexpr int LOD_TIER_COUNT = 3;
+
+	struct LodTier
+	{
+		std::vector<RigidBody*> bodies;
+		std::vector<BodyPair> pairs;
+		std::vector<BodyPair> circlePairs;
+		std::vector<JointConstraint*> joints;
+	};
+
+	std::vector<Vec2> m_focusPoints;
+	float m_lodNearDistance = 1280.0f;
+	float m_lodFarDistance = 2560.0f;
+	uint64_t m_lodTick = 0;
+	uint32_t m_steppedLodTiers = ~0U; // Tiers stepped by the last step, one bit each
+	LodTier m_lodTiers[LOD_TIER_COUNT];
+	std::vector<std::size_t> m_islandParents; // Union find over the dynamic bodies
+	std::vector<int> m_islandTiers;
+	std::vector<int> m_lodDistanceTiers; // Tier of every dynamic body from its distance, before the islands
+
 public:
 	explicit World(float gravity);
+	~World();
+
+	[[nodiscard]] float GetGravity() const;
 
+	// Bodies with no mass are static: they must not move once added, as they are only tested against the dynamic bodies
+	// through a tree built once. Sensors only detect the dynamic bodies: a static sensor is tested against the dynamic
+	// bodies, a dynamic one against the other dynamic bodies, and two sensors never detect each other.
 	void AddBody(RigidBody* body);
 	std::vector<RigidBody*>& GetBodies();
+	[[nodiscard]] const std::vector<RigidBody*>& GetBodies() const;
+	[[nodiscard]] const std::vector<RigidBody*>& GetStaticBodies() const;
+	[[nodiscard]] const std::vector<RigidBody*>& GetDynamicBodies() const;
 
 	void AddConstraint(JointConstraint* constraint);
 	std::vector<JointConstraint*>& GetConstraints();
+	[[nodiscard]] const std::vector<JointConstraint*>& GetConstraints() const;
+
+	// Deferred changes, safe to queue from any thread and at any time, even during a step or from an event handler.
+	// They are applied together at the start of the next step, or by FlushCommands, in the order they were queued: the
+	// bodies are appended in one go, the static tree is rebuilt once, and every removal is done in a single pass over
+	// the bodies and the state kept for them. The world does not own the bodies and joints it lets go of. Removing a body
+	// also removes its joints, and forgets its contacts and sensor overlaps without end events. Adding a body or joint the
+	// world already holds, or removing one it does not hold, does nothing, and so does setting the velocity of a body it
+	// does not hold or that is removed by the same flush.
+	void QueueAddBody(RigidBody* body);
+	void QueueRemoveBody(RigidBody* body);
+	void QueueSetVelocity(RigidBody* body, const Vec2& velocity, float angularVelocity);
+	void QueueAddConstraint(JointConstraint* constraint);
+	void QueueRemoveConstraint(JointConstraint* constraint);
+	void FlushCommands();
 
 	void AddForce(const Vec2& force);
 	void AddTorque(float torque);
+	[[nodiscard]] const std::vector<Vec2>& GetForces() const;
+	[[nodiscard]] const std::vector<float>& GetTorques() const;
+
+	void SetSolver(SolverType solver);
+	[[nodiscard]] SolverType GetSolver() const;
+	void SetSubsteps(int substeps);
+	[[nodiscard]] int GetSubsteps() const;
+
+	// The iterative solver stops once the residual falls below the tolerance, or after the maximum number of iterations
+	void SetIterations(int maxIterations);
+	[[nodiscard]] int GetIterations() const;
+	void SetTolerance(float tolerance);
+	[[nodiscard]] float GetTolerance() const;
+	[[nodiscard]] const StepStats& GetStepStats() const;
+
+	void GetSatCache(std::vector<SatCacheRecord>& outRecords) const;
+	void SetSatCache(const std::vector<SatCacheRecord>& records);
+
+	// Pairs touching at the end of the last step, saved and restored with the bodies so the next step reports the same
+	// begin, persist and end events
+	[[nodiscard]] const std::vector<ContactEvent>& GetTouching() const;
+	void SetTouching(const std::vector<ContactEvent>& touching);
+
+	// Bodies overlapping a sensor at the end of the last step, saved and restored like the touching pairs
+	[[nodiscard]] const std::vector<SensorEvent>& GetSensorOverlaps() const;
+	void SetSensorOverlaps(const std::vector<SensorEvent>& overlaps);
 
-	void Update(float dt) const;
+	void GetContactImpulses(std::vector<ContactImpulseRecord>& outRecords) const;
+	void SetContactImpulses(const std::vector<ContactImpulseRecord>& records);
+
+	// Contact position correction of the iterative solver, the soft step has its own
+	void SetPositionCorrection(PositionCorrection correction);
+	[[nodiscard]] PositionCorrection GetPositionCorrection() const;
+	void SetPositionIterations(int positionIterations);
+	[[nodiscard]] int GetPositionIterations() const;
+
+	// Job system the steps split their work across, not owned by the world. Without one (the default) the world steps on
+	// the calling thread. The results are the same on any number of threads, only the time of a step changes.
+	void SetJobSystem(JobSystem* jobSystem);
+	[[nodiscard]] JobSystem* GetJobSystem() const;
+
+	// The sequential order solves the constraints one after the other, as a single thread always did. The colored order
+	// solves the constraints of a color together across the job system: it converges a bit slower and gives other
+	// results than the sequential one, but the same on any number of threads.
+	void SetSolverOrder(SolverOrder order);
+	[[nodiscard]] SolverOrder GetSolverOrder() const;
+
+	// Hash of the position, rotation and velocities of the dynamic bodies. Worlds stepped from the same state with the
+	// same settings have the same hash after every step, whatever the thread count.
+	[[nodiscard]] uint64_t ComputeStateHash() const;
+
+	// Simulation level of detail. With focus points (the camera, the players), an island of dynamic bodies (linked by
+	// contacts and joints) farther than the near distance from all of them steps on every other tick with twice the time
+	// step, farther than the far distance on every 4th tick with 4 times the time step. An island steps with the tier of
+	// its body closest to a focus point, so a pair across two tiers is solved at the finer rate. Without focus points (the
+	// default) every body steps on every tick.
+	void SetFocusPoints(const std::vector<Vec2>& points);
+	[[nodiscard]] const std::vector<Vec2>& GetFocusPoints() const;
+	void SetLodDistances(float nearDistance, float farDistance);
+	[[nodiscard]] float GetLodNearDistance() const;
+	[[nodiscard]] float GetLodFarDistance() const;
+	// Steps taken with focus points, a tier steps when its rate divides the next one. Part of the state to restore for
+	// the same steps again.
+	void SetLodTick(uint64_t tick);
+	[[nodiscard]] uint64_t GetLodTick() const;
+
+	void Update(float dt);
+
+	// Filled by every step, to be read before the next one
+	[[nodiscard]] const ContactEvents& GetContactEvents() const;
+	[[nodiscard]] const SensorEvents& GetSensorEvents() const;
+
+	// Spatial queries, on the world as it was after the last step. Candidates come from the static tree and the boxes of
+	// the dynamic bodies, then go through the exact test of their shape. They only read the world: they can run from
+	// several threads at once, as long as no step runs at the same time. Rays go through the sensors, the other queries
+	// report them.
+	// Closest body hit by the ray from start to end, false when it hits nothing
+	bool RayCast(const Vec2& start, const Vec2& end, RayCastHit& outHit) const;
+	// Every body hit by the ray, from the closest to the farthest
+	void RayCastAll(const Vec2& start, const Vec2& end, std::vector<RayCastHit>& outHits) const;
+	// Closest hit of every ray, in the order of the rays, split across the job system when the world has one
+	void RayCastBatch(const std::vector<RayCastInput>& rays, std::vector<RayCastHit>& outHits) const;
+	// Bodies whose bounding box overlaps the box
+	void QueryAABB(const AABB& box, std::vector<RigidBody*>& outBodies) const;
+	// Bodies whose shape contains the point
+	void QueryPoint(const Vec2& point, std::vector<RigidBody*>& outBodies) const;
+	// Bodies whose shape overlaps the given shape, already placed by the caller with Shape::UpdateVertices. The query
+	// allocates nothing when the output has the capacity for the candidates.
+	void QueryShape(const Shape& shape, std::vector<RigidBody*>& outBodies) const;
+
+private:
+	void QueryBroadPhase(const AABB& box, std::vector<RigidBody*>& outBodies) const;
+	void RayCastBroadPhase(const Vec2& start, const Vec2& end, std::vector<RigidBody*>& outBodies) const;
+	[[nodiscard]] std::size_t GrainSize(std::size_t count, std::size_t minGrain) const;
+	template <typename Body>
+	void ParallelFor(std::size_t count, std::size_t grain, const Body& body) const;
+	void StartStep(RigidBody* body, float dt) const;
+	void StepBodies(std::vector<PenetrationConstraint>& penetrations, float dt, bool hasPairs);
+	void StepLevelsOfDetail(std::vector<PenetrationConstraint>& penetrations, float dt);
+	void BuildIslands();
+	void FindAllPairs(float dt);
+	void NarrowPhase(std::vector<PenetrationConstraint>& penetrations);
+	void PruneSatCache();
+	void PruneContactImpulses();
+	void FindPairs(std::size_t first, std::size_t last, float dt, PairRange& outRange) const;
+	[[nodiscard]] bool ShouldCollide(const RigidBody* a, const RigidBody* b) const;
+	void TestPairs(std::vector<PenetrationConstraint>& penetrations);
+	void TestCirclePairs(std::vector<PenetrationConstraint>& penetrations);
+	void AddContactPair(const Contact* contacts, std::size_t count, const std::vector<PenetrationConstraint>& penetrations);
+	void ReportContacts(const std::vector<PenetrationConstraint>& penetrations);
+	void ReportSensors();
+	void ColorConstraints(const std::vector<PenetrationConstraint>& penetrations);
+	template <typename JointPass, typename PenetrationPass>
+	void SolveConstraints(std::vector<PenetrationConstraint>& penetrations, float& inOutImpulse, const JointPass& jointPass, const PenetrationPass& penetrationPass);
+	template <typename JointPass, typename PenetrationPass>
+	void ForEachConstraint(std::vector<PenetrationConstraint>& penetrations, const JointPass& jointPass, const PenetrationPass& penetrationPass);
+	void WarmStartContacts(std::vector<PenetrationConstraint>& penetrations);
+	void CacheContactImpulses(const std::vector<PenetrationConstraint>& penetrations);
+	void SolveIterative(std::vector<PenetrationConstraint>& penetrations, float dt);
+	void SolveSoftStep(std::vector<PenetrationConstraint>& penetrations, float dt);
+	void SolveTimeOfImpact() const;
 };